@@ -0,0 +1,107 @@
+// allocator_base::zeroize/fill/move against memset/memmove, below and above the last level cache.
+//     cl /O2 /EHsc /std:c++14 /I.. /I<cppformat parent> memory_bench.cpp && memory_bench
+// Prints GB/s (best of a few runs) and how long re-reading a small warm working set takes afterwards:
+// above the cache size streaming stores should leave it cached.
+#include "dmk_memory.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    typedef dmk::allocator_base base;
+
+    enum
+    {
+        Runs = 5
+    };
+
+    double seconds_since( std::chrono::steady_clock::time_point start )
+    {
+        return std::chrono::duration<double>( std::chrono::steady_clock::now( ) - start ).count( );
+    }
+
+    template <typename _Function>
+    double best_seconds( _Function fn )
+    {
+        double best = 1e9;
+        for ( int i = 0; i < Runs; i++ )
+        {
+            auto start  = std::chrono::steady_clock::now( );
+            fn( );
+            double time = seconds_since( start );
+            best        = time < best ? time : best;
+        }
+        return best;
+    }
+
+    // reads every line of the working set, returns the seconds it took
+    volatile uint64_t sink;
+    double scan( const std::vector<uint64_t>& working_set )
+    {
+        auto start   = std::chrono::steady_clock::now( );
+        uint64_t sum = 0;
+        for ( size_t i = 0; i < working_set.size( ); i += dmk::CacheSize / sizeof( uint64_t ) )
+        {
+            sum += working_set[i];
+        }
+        sink = sum;
+        return seconds_since( start );
+    }
+
+    // the old fill: one memmove per element
+    template <size_t itemsize>
+    void fill_per_item( uint8_t* begin, uint8_t* end, const void* source )
+    {
+        for ( ; begin + itemsize <= end; begin += itemsize )
+        {
+            std::memmove( begin, source, itemsize );
+        }
+    }
+
+    template <typename _Reference, typename _Candidate>
+    void compare( const char* name, size_t size, std::vector<uint64_t>& working_set, _Reference reference,
+                  _Candidate candidate )
+    {
+        double gb = double( size ) / 1e9;
+        scan( working_set );
+        double reference_time   = best_seconds( reference );
+        double reference_reread = scan( working_set );
+        scan( working_set );
+        double candidate_time   = best_seconds( candidate );
+        double candidate_reread = scan( working_set );
+        std::printf( "%-10s %10zu KB  reference %7.2f GB/s  dmk %7.2f GB/s  reread %6.0f us / %6.0f us\n",
+                     name, size / 1024, gb / reference_time, gb / candidate_time, reference_reread * 1e6,
+                     candidate_reread * 1e6 );
+    }
+} // namespace
+
+int main( )
+{
+    size_t llc = dmk::last_level_cache_size( );
+    std::printf( "last level cache %zu KB, streaming above it\n", llc / 1024 );
+    size_t working_bytes = llc / 2 < 4 * 1024 * 1024 ? llc / 2 : 4 * 1024 * 1024;
+    std::vector<uint64_t> working_set( working_bytes / sizeof( uint64_t ), 1 );
+
+    const size_t sizes[] = { 256 * 1024, llc / 4, llc / 2, llc * 2 };
+    for ( size_t size : sizes )
+    {
+        dmk::aligned_buffer<uint8_t, dmk::PageSize> source( size, 1 );
+        dmk::aligned_buffer<uint8_t, dmk::PageSize> destination( size, 2 );
+        uint8_t* from            = source.data( );
+        uint8_t* to              = destination.data( );
+        const uint32_t word      = 0x01020304;
+        const uint8_t triple[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+
+        compare( "zeroize", size, working_set, [&]( ) { std::memset( to, 0, size ); },
+                 [&]( ) { base::zeroize( to, to + size ); } );
+        compare( "move", size, working_set, [&]( ) { std::memmove( to, from, size ); },
+                 [&]( ) { base::move( from, from + size, to ); } );
+        compare( "fill<4>", size, working_set, [&]( ) { fill_per_item<4>( to, to + size, &word ); },
+                 [&]( ) { base::fill<4>( to, to + size, &word ); } );
+        compare( "fill<12>", size, working_set, [&]( ) { fill_per_item<12>( to, to + size, triple ); },
+                 [&]( ) { base::fill<12>( to, to + size, triple ); } );
+    }
+    return 0;
+}
@@ -15,6 +15,10 @@
 #define DMK_ARCH_SSE 1
 #endif
 
+#if defined( __AVX2__ )
+#define DMK_ARCH_AVX2 1
+#endif
+
 // OS
 
 #if defined( _WIN32 )
@@ -25,6 +29,9 @@
 #define DMK_OS_MAC 1
 #define DMK_OS_OSX 1
 #endif
+#if defined( __linux__ )
+#define DMK_OS_LINUX 1
+#endif
 #endif
 
 // Compiler
@@ -138,6 +145,10 @@
 #include <cstdint>
 #include <cinttypes>
 
+#if defined( DMK_COMPILER_MSVC )
+#include <intrin.h>
+#endif
+
 namespace dmk
 {
     template <typename T, std::size_t N>
@@ -245,4 +256,59 @@ namespace dmk
     {
     };
 
+    // Index of the lowest set bit (value must not be zero)
+    DMK_ALWAYS_INLINE unsigned bit_scan_forward( uint64_t value )
+    {
+#if defined( DMK_COMPILER_MSVC ) && defined( DMK_ARCH_X64 )
+        unsigned long index;
+        _BitScanForward64( &index, value );
+        return index;
+#elif defined( DMK_COMPILER_MSVC )
+        unsigned long index;
+        if ( _BitScanForward( &index, uint32_t( value ) ) )
+            return index;
+        _BitScanForward( &index, uint32_t( value >> 32 ) );
+        return index + 32;
+#else
+        return __builtin_ctzll( value );
+#endif
+    }
+
+    // Index of the highest set bit (value must not be zero)
+    DMK_ALWAYS_INLINE unsigned bit_scan_reverse( uint64_t value )
+    {
+#if defined( DMK_COMPILER_MSVC ) && defined( DMK_ARCH_X64 )
+        unsigned long index;
+        _BitScanReverse64( &index, value );
+        return index;
+#elif defined( DMK_COMPILER_MSVC )
+        unsigned long index;
+        if ( _BitScanReverse( &index, uint32_t( value >> 32 ) ) )
+            return index + 32;
+        _BitScanReverse( &index, uint32_t( value ) );
+        return index;
+#else
+        return 63 - __builtin_clzll( value );
+#endif
+    }
+
+    // Number of set bits
+    DMK_ALWAYS_INLINE unsigned bit_count( uint64_t value )
+    {
+#if defined( DMK_COMPILER_MSVC )
+        value = value - ( ( value >> 1 ) & 0x5555555555555555ull );
+        value = ( value & 0x3333333333333333ull ) + ( ( value >> 2 ) & 0x3333333333333333ull );
+        value = ( value + ( value >> 4 ) ) & 0x0F0F0F0F0F0F0F0Full;
+        return unsigned( ( value * 0x0101010101010101ull ) >> 56 );
+#else
+        return __builtin_popcountll( value );
+#endif
+    }
+
+    // Smallest power of two >= value (1 for 0)
+    DMK_ALWAYS_INLINE size_t round_up_pow2( size_t value )
+    {
+        return value <= 1 ? 1 : size_t( 1 ) << ( bit_scan_reverse( value - 1 ) + 1 );
+    }
+
 } // namespace dmk
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "dmk.h"
+#include "dmk_memory.h"
+#include <atomic>
+#include <new>
+#include <thread>
+
+namespace dmk
+{
+    // Small per-thread number used to spread threads over shards
+    inline size_t thread_shard_index( )
+    {
+        static std::atomic<size_t> next( 0 );
+        static thread_local size_t index = next.fetch_add( 1, std::memory_order_relaxed );
+        return index;
+    }
+
+    // Counter split into cache-line padded slots, one per thread (modulo the slot count).
+    // Increments touch only the thread's own line, value( ) adds all slots up.
+    struct sharded_counter
+    {
+    public:
+        typedef cache_aligned<std::atomic<int64_t>> slot;
+
+    public:
+        // shards = 0: a power of two >= number of hardware threads
+        explicit sharded_counter( size_t shards = 0 )
+        {
+            if ( shards == 0 )
+                shards = std::thread::hardware_concurrency( );
+            m_mask         = round_up_pow2( shards ) - 1;
+            size_t size    = ( m_mask + 1 ) * sizeof( slot );
+            m_slots        = ( slot* )aligned_allocator<CacheSize>::allocate( size );
+            if ( !m_slots )
+                throw std::bad_alloc( );
+            for ( size_t i = 0; i <= m_mask; i++ )
+            {
+                new ( m_slots + i ) slot( 0 );
+            }
+        }
+        sharded_counter( const sharded_counter& ) = delete;
+        sharded_counter& operator=( const sharded_counter& ) = delete;
+        ~sharded_counter( )
+        {
+            aligned_allocator<CacheSize>::deallocate( m_slots );
+        }
+
+        void add( int64_t value )
+        {
+            m_slots[thread_shard_index( ) & m_mask]->fetch_add( value, std::memory_order_relaxed );
+        }
+        sharded_counter& operator+=( int64_t value )
+        {
+            add( value );
+            return *this;
+        }
+        sharded_counter& operator-=( int64_t value )
+        {
+            add( -value );
+            return *this;
+        }
+        sharded_counter& operator++( )
+        {
+            add( 1 );
+            return *this;
+        }
+        sharded_counter& operator--( )
+        {
+            add( -1 );
+            return *this;
+        }
+
+        // sum of all slots (not a snapshot while other threads keep adding)
+        int64_t value( ) const
+        {
+            int64_t sum = 0;
+            for ( size_t i = 0; i <= m_mask; i++ )
+            {
+                sum += m_slots[i]->load( std::memory_order_relaxed );
+            }
+            return sum;
+        }
+        operator int64_t( ) const
+        {
+            return value( );
+        }
+
+        // returns the value and sets the counter to zero
+        int64_t reset( )
+        {
+            int64_t sum = 0;
+            for ( size_t i = 0; i <= m_mask; i++ )
+            {
+                sum += m_slots[i]->exchange( 0, std::memory_order_relaxed );
+            }
+            return sum;
+        }
+
+        size_t shards( ) const
+        {
+            return m_mask + 1;
+        }
+
+    private:
+        slot* m_slots;
+        size_t m_mask;
+    };
+} // namespace dmk
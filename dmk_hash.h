@@ -0,0 +1,337 @@
+#pragma once
+
+#include "dmk.h"
+#include <cstring>
+#include <emmintrin.h>
+#if defined( DMK_ARCH_AVX2 )
+#include <immintrin.h>
+#endif
+
+namespace dmk
+{
+    // Fast non-cryptographic 64-bit hash.
+    // Up to 256 bytes: wyhash-style 64x64->128 bit multiply-and-fold over 16 byte pairs.
+    // Longer input: 64 byte stripes accumulated into eight 64-bit lanes with SSE2/AVX2 32x32->64 bit
+    // multiplies, scrambled every 512 bytes (the scheme of xxh3), then folded the same way.
+    // Not stable across library versions, do not persist the values
+    namespace _hash
+    {
+        enum
+        {
+            StripeSize      = 64,
+            StripesPerBlock = 8,
+            ShortLimit      = 256, // longer input goes to the striped path
+            Keys            = 24
+        };
+
+        // key k of a stripe s in the block is Keys[s + k], scrambling uses [16, 24), merging [8, 16),
+        // the last stripe [15, 23)
+        inline const uint64_t* secret( )
+        {
+            static constexpr uint64_t keys[Keys] = {
+                0x07C3E62447CE57E9ull, 0x2EC746997017125Full, 0x1F1D1F01A9D9A511ull, 0xE46893867C089F4Full,
+                0xC0DF8EB985855A47ull, 0xDB0AF0C78DAB8A6Dull, 0x903E33C18CC9C5BDull, 0xE7849B9950A04F7Full,
+                0xC3774FAA730EF045ull, 0x53ADE73A011C4BF9ull, 0x61B03F5E52C5C6CBull, 0xCCA127EC66A0ED51ull,
+                0xCA896360C64495FBull, 0x2C7DA9C2927CD89Dull, 0x9165B049D759F8ABull, 0x5A35F009EE9CA8B5ull,
+                0x4E8BCA354B4DD2C7ull, 0xC410B3776D52750Bull, 0x14F518CE7682FA49ull, 0xB06DAF1D2739D381ull,
+                0x7DDC7C0A4A2258CFull, 0x7DCA4029C477816Full, 0xCBBD8010E84DE2F3ull, 0x5A7B1301FB3A50B3ull,
+            };
+            return keys;
+        }
+
+        inline uint64_t read64( const uint8_t* p )
+        {
+            uint64_t value;
+            std::memcpy( &value, p, sizeof( value ) );
+            return value;
+        }
+
+        inline uint64_t read32( const uint8_t* p )
+        {
+            uint32_t value;
+            std::memcpy( &value, p, sizeof( value ) );
+            return value;
+        }
+
+        // Full 128-bit product of a and b, folded to 64 bits
+        inline uint64_t mix( uint64_t a, uint64_t b )
+        {
+#if defined( __SIZEOF_INT128__ )
+            unsigned __int128 product = ( unsigned __int128 )a * b;
+            return uint64_t( product ) ^ uint64_t( product >> 64 );
+#elif defined( DMK_COMPILER_MSVC ) && defined( DMK_ARCH_X64 )
+            uint64_t high;
+            uint64_t low = _umul128( a, b, &high );
+            return low ^ high;
+#else
+            uint64_t ll = ( a & 0xFFFFFFFF ) * ( b & 0xFFFFFFFF ), lh = ( a & 0xFFFFFFFF ) * ( b >> 32 );
+            uint64_t hl = ( a >> 32 ) * ( b & 0xFFFFFFFF ), hh = ( a >> 32 ) * ( b >> 32 );
+            uint64_t middle = ( ll >> 32 ) + ( lh & 0xFFFFFFFF ) + ( hl & 0xFFFFFFFF );
+            uint64_t low    = ( ll & 0xFFFFFFFF ) | ( middle << 32 );
+            uint64_t high   = hh + ( lh >> 32 ) + ( hl >> 32 ) + ( middle >> 32 );
+            return low ^ high;
+#endif
+        }
+
+        inline uint64_t avalanche( uint64_t h )
+        {
+            h ^= h >> 37;
+            h *= 0x165667919E3779F9ull;
+            return h ^ ( h >> 32 );
+        }
+
+        inline uint64_t short_hash( const uint8_t* p, size_t size, uint64_t seed )
+        {
+            const uint64_t* k = secret( );
+            seed ^= mix( seed ^ k[0], k[1] );
+            uint64_t a, b;
+            if ( size <= 16 )
+            {
+                if ( size >= 4 )
+                {
+                    size_t shift = ( size >> 3 ) << 2;
+                    a            = ( read32( p ) << 32 ) | read32( p + shift );
+                    b            = ( read32( p + size - 4 ) << 32 ) | read32( p + size - 4 - shift );
+                }
+                else if ( size > 0 )
+                {
+                    a = ( uint64_t( p[0] ) << 16 ) | ( uint64_t( p[size >> 1] ) << 8 ) | p[size - 1];
+                    b = 0;
+                }
+                else
+                {
+                    a = b = 0;
+                }
+            }
+            else
+            {
+                size_t i = size;
+                if ( i > 48 )
+                {
+                    // three independent chains
+                    uint64_t seed1 = seed, seed2 = seed;
+                    do
+                    {
+                        seed  = mix( read64( p ) ^ k[1], read64( p + 8 ) ^ seed );
+                        seed1 = mix( read64( p + 16 ) ^ k[2], read64( p + 24 ) ^ seed1 );
+                        seed2 = mix( read64( p + 32 ) ^ k[3], read64( p + 40 ) ^ seed2 );
+                        p += 48;
+                        i -= 48;
+                    } while ( i > 48 );
+                    seed ^= seed1 ^ seed2;
+                }
+                for ( ; i > 16; i -= 16, p += 16 )
+                {
+                    seed = mix( read64( p ) ^ k[1], read64( p + 8 ) ^ seed );
+                }
+                a = read64( p + i - 16 );
+                b = read64( p + i - 8 );
+            }
+            return mix( k[1] ^ size, mix( a ^ k[1], b ^ seed ) );
+        }
+
+        // acc[k ^ 1] += data[k], acc[k] += low32( data[k] ^ key[k] ) * high32( data[k] ^ key[k] )
+        inline void accumulate( uint64_t* acc, const uint8_t* p, const uint64_t* key )
+        {
+#if defined( DMK_ARCH_AVX2 )
+            for ( int i = 0; i < 2; i++ )
+            {
+                __m256i data    = _mm256_loadu_si256( ( const __m256i* )p + i );
+                __m256i keyed   = _mm256_xor_si256( data, _mm256_loadu_si256( ( const __m256i* )key + i ) );
+                __m256i product = _mm256_mul_epu32( keyed, _mm256_srli_epi64( keyed, 32 ) );
+                __m256i swapped = _mm256_shuffle_epi32( data, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+                __m256i sum     = _mm256_loadu_si256( ( const __m256i* )acc + i );
+                sum             = _mm256_add_epi64( _mm256_add_epi64( sum, swapped ), product );
+                _mm256_storeu_si256( ( __m256i* )acc + i, sum );
+            }
+#else
+            for ( int i = 0; i < 4; i++ )
+            {
+                __m128i data    = _mm_loadu_si128( ( const __m128i* )p + i );
+                __m128i keyed   = _mm_xor_si128( data, _mm_loadu_si128( ( const __m128i* )key + i ) );
+                __m128i product = _mm_mul_epu32( keyed, _mm_srli_epi64( keyed, 32 ) );
+                __m128i swapped = _mm_shuffle_epi32( data, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+                __m128i sum     = _mm_add_epi64( _mm_loadu_si128( ( const __m128i* )acc + i ), swapped );
+                _mm_storeu_si128( ( __m128i* )acc + i, _mm_add_epi64( sum, product ) );
+            }
+#endif
+        }
+
+        // acc = ( acc ^ ( acc >> 47 ) ^ key ) * prime, done as two 32x32 bit multiplies
+        inline void scramble( uint64_t* acc, const uint64_t* key )
+        {
+            const __m128i prime = _mm_set1_epi32( int( 0x9E3779B1 ) );
+            for ( int i = 0; i < 4; i++ )
+            {
+                __m128i a    = _mm_loadu_si128( ( const __m128i* )acc + i );
+                a            = _mm_xor_si128( a, _mm_srli_epi64( a, 47 ) );
+                a            = _mm_xor_si128( a, _mm_loadu_si128( ( const __m128i* )key + i ) );
+                __m128i low  = _mm_mul_epu32( a, prime );
+                __m128i high = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), prime );
+                _mm_storeu_si128( ( __m128i* )acc + i, _mm_add_epi64( low, _mm_slli_epi64( high, 32 ) ) );
+            }
+        }
+
+        inline void init( uint64_t* acc )
+        {
+            static constexpr uint64_t initial[8] = {
+                0x000000009E3779B1ull, 0x9E3779B185EBCA87ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+                0x85EBCA77C2B2AE63ull, 0x0000000085EBCA77ull, 0x27D4EB2F165667C5ull, 0x00000000C2B2AE3Dull,
+            };
+            std::memcpy( acc, initial, sizeof( initial ) );
+        }
+
+        // stripe is the index of the first one in its block, returns the index after the last
+        inline size_t stripes( uint64_t* acc, const uint8_t* p, size_t count, size_t stripe,
+                               const uint64_t* keys )
+        {
+            for ( size_t i = 0; i < count; i++, p += StripeSize )
+            {
+                accumulate( acc, p, keys + stripe );
+                if ( ++stripe == StripesPerBlock )
+                {
+                    scramble( acc, keys + 16 );
+                    stripe = 0;
+                }
+            }
+            return stripe;
+        }
+
+        // last holds the final 64 bytes of the input
+        inline uint64_t finish( uint64_t* acc, const uint8_t* last, uint64_t size, const uint64_t* keys )
+        {
+            accumulate( acc, last, keys + 15 );
+            uint64_t h = size * 0x9E3779B185EBCA87ull;
+            for ( int i = 0; i < 8; i += 2 )
+            {
+                h += mix( acc[i] ^ keys[8 + i], acc[i + 1] ^ keys[9 + i] );
+            }
+            return avalanche( h );
+        }
+
+        inline void seeded( uint64_t* keys, uint64_t seed )
+        {
+            const uint64_t* k = secret( );
+            for ( int i = 0; i < Keys; i++ )
+            {
+                keys[i] = ( i & 1 ) ? k[i] - seed : k[i] + seed;
+            }
+        }
+
+        inline uint64_t long_hash( const uint8_t* p, size_t size, uint64_t seed )
+        {
+            uint64_t keys[Keys];
+            const uint64_t* k = secret( );
+            if ( seed != 0 )
+            {
+                seeded( keys, seed );
+                k = keys;
+            }
+            uint64_t acc[8];
+            init( acc );
+            stripes( acc, p, ( size - 1 ) / StripeSize, 0, k );
+            return finish( acc, p + size - StripeSize, size, k );
+        }
+    } // namespace _hash
+
+    inline uint64_t hash( const void* data, size_t size, uint64_t seed = 0 )
+    {
+        const uint8_t* p = static_cast<const uint8_t*>( data );
+        if ( size <= _hash::ShortLimit )
+            return _hash::short_hash( p, size, seed );
+        return _hash::long_hash( p, size, seed );
+    }
+
+    // Incremental form of hash( ): any split of the input into update( ) calls gives the same digest( )
+    // as one hash( data, size, seed ) call over all of it
+    struct hasher
+    {
+    public:
+        explicit hasher( uint64_t seed = 0 )
+        {
+            reset( seed );
+        }
+
+        void reset( uint64_t seed = 0 )
+        {
+            m_seed     = seed;
+            m_size     = 0;
+            m_buffered = 0;
+            m_stripe   = 0;
+            _hash::init( m_acc );
+            if ( seed != 0 )
+                _hash::seeded( m_keys, seed );
+            else
+                std::memcpy( m_keys, _hash::secret( ), sizeof( m_keys ) );
+        }
+
+        hasher& update( const void* data, size_t size )
+        {
+            const uint8_t* p = static_cast<const uint8_t*>( data );
+            m_size += size;
+            if ( m_buffered + size <= BufferSize )
+            {
+                if ( size )
+                    std::memcpy( m_buffer + m_buffered, p, size );
+                m_buffered += size;
+                return *this;
+            }
+            // stripes are consumed only when more input follows, the last one is done by digest( )
+            if ( m_buffered )
+            {
+                size_t fill = BufferSize - m_buffered;
+                std::memcpy( m_buffer + m_buffered, p, fill );
+                p += fill;
+                size -= fill;
+                m_stripe   = _hash::stripes( m_acc, m_buffer, BufferStripes, m_stripe, m_keys );
+                m_buffered = 0;
+            }
+            if ( size > BufferSize )
+            {
+                do
+                {
+                    m_stripe = _hash::stripes( m_acc, p, BufferStripes, m_stripe, m_keys );
+                    p += BufferSize;
+                    size -= BufferSize;
+                } while ( size > BufferSize );
+                // the last stripe may reach back into consumed input
+                const size_t tail = _hash::StripeSize;
+                std::memcpy( m_buffer + BufferSize - tail, p - tail, tail );
+            }
+            std::memcpy( m_buffer, p, size );
+            m_buffered = size;
+            return *this;
+        }
+
+        uint64_t digest( ) const
+        {
+            if ( m_size <= _hash::ShortLimit )
+                return _hash::short_hash( m_buffer, size_t( m_size ), m_seed );
+            uint64_t acc[8];
+            std::memcpy( acc, m_acc, sizeof( acc ) );
+            _hash::stripes( acc, m_buffer, ( m_buffered - 1 ) / _hash::StripeSize, m_stripe, m_keys );
+            if ( m_buffered >= _hash::StripeSize )
+                return _hash::finish( acc, m_buffer + m_buffered - _hash::StripeSize, m_size, m_keys );
+            uint8_t last[_hash::StripeSize];
+            size_t previous = _hash::StripeSize - m_buffered;
+            std::memcpy( last, m_buffer + BufferSize - previous, previous );
+            std::memcpy( last + previous, m_buffer, m_buffered );
+            return _hash::finish( acc, last, m_size, m_keys );
+        }
+
+    private:
+        enum
+        {
+            BufferSize    = _hash::ShortLimit,
+            BufferStripes = BufferSize / _hash::StripeSize
+        };
+
+        uint64_t m_acc[8];
+        uint64_t m_keys[_hash::Keys];
+        uint8_t m_buffer[BufferSize];
+        uint64_t m_seed;
+        uint64_t m_size;
+        size_t m_buffered;
+        size_t m_stripe;
+    };
+} // namespace dmk
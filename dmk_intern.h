@@ -0,0 +1,341 @@
+#pragma once
+
+#include "dmk.h"
+#include "dmk_memory.h"
+#include "dmk_string.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace dmk
+{
+    // Handle to a string stored once in an intern_pool. Two handles from the same pool are equal
+    // exactly when their strings are, so comparing and hashing is a pointer/integer operation.
+    // Valid as long as the pool is alive
+    struct interned
+    {
+    public:
+        // storage layout in the pool's arena, the string follows the header (null-terminated)
+        struct entry
+        {
+            uint64_t hash;
+            uint32_t id;
+            uint32_t size;
+
+            const char* data( ) const
+            {
+                return reinterpret_cast<const char*>( this + 1 );
+            }
+        };
+
+    public:
+        interned( ) noexcept : m_entry( nullptr )
+        {
+        }
+        explicit interned( const entry* e ) noexcept : m_entry( e )
+        {
+        }
+
+        bool empty( ) const
+        {
+            return !m_entry || m_entry->size == 0;
+        }
+        explicit operator bool( ) const
+        {
+            return m_entry != nullptr;
+        }
+        // dense number in the pool (0, 1, 2, ... in order of interning)
+        uint32_t id( ) const
+        {
+            return m_entry ? m_entry->id : uint32_t( -1 );
+        }
+        uint64_t hash( ) const
+        {
+            return m_entry ? m_entry->hash : 0;
+        }
+        const char* c_str( ) const
+        {
+            return m_entry ? m_entry->data( ) : "";
+        }
+        size_t size( ) const
+        {
+            return m_entry ? m_entry->size : 0;
+        }
+        u8string_view view( ) const
+        {
+            return u8string_view( c_str( ), size( ) );
+        }
+        operator u8string_view( ) const
+        {
+            return view( );
+        }
+
+        bool operator==( const interned& other ) const
+        {
+            return m_entry == other.m_entry;
+        }
+        bool operator!=( const interned& other ) const
+        {
+            return m_entry != other.m_entry;
+        }
+        // arbitrary but stable order (by id), not lexicographic
+        bool operator<( const interned& other ) const
+        {
+            return id( ) < other.id( );
+        }
+
+    private:
+        const entry* m_entry;
+    };
+
+    inline std::ostream& operator<<( std::ostream& os, const interned& str )
+    {
+        return os << str.view( );
+    }
+
+    // Deduplicating string table. Strings are copied once into per-shard arenas and never move.
+    // Lookups of strings that are already interned are lock-free: every shard is an open addressing
+    // table of atomic entry pointers. Inserts take the shard's lock; a growing shard publishes a new
+    // table and keeps the old one alive, so concurrent readers never see freed memory
+    struct intern_pool
+    {
+    public:
+        typedef interned::entry entry;
+
+        enum
+        {
+            ShardBits    = 4,
+            Shards       = 1 << ShardBits,
+            InitialSlots = 64, // per shard, power of two
+            IdChunkBits  = 10, // id table chunks hold 1024, 2048, 4096, ... entries
+            IdChunks     = 22
+        };
+
+    public:
+        intern_pool( ) : m_count( 0 )
+        {
+            for ( shard& s : m_shards )
+            {
+                s.tables.push_back( new table( InitialSlots ) );
+                s.current.store( s.tables.back( ), std::memory_order_relaxed );
+            }
+            for ( std::atomic<id_slot*>& chunk : m_ids )
+            {
+                chunk.store( nullptr, std::memory_order_relaxed );
+            }
+        }
+        intern_pool( const intern_pool& ) = delete;
+        intern_pool& operator=( const intern_pool& ) = delete;
+        ~intern_pool( )
+        {
+            for ( shard& s : m_shards )
+            {
+                for ( table* t : s.tables )
+                {
+                    delete t;
+                }
+            }
+            for ( std::atomic<id_slot*>& chunk : m_ids )
+            {
+                delete[] chunk.load( std::memory_order_relaxed );
+            }
+        }
+
+        // returns the handle of the stored copy, storing str first if it is new
+        interned intern( u8string_view str )
+        {
+            uint64_t hash = hash_of( str );
+            shard& s      = m_shards[hash & ( Shards - 1 )];
+            if ( const entry* e = find( s.current.load( std::memory_order_acquire ), str, hash ) )
+                return interned( e );
+
+            std::lock_guard<std::mutex> lock( s.mutex );
+            table* t = s.current.load( std::memory_order_relaxed );
+            if ( const entry* e = find( t, str, hash ) )
+                return interned( e ); // inserted by another thread meanwhile
+            if ( ( t->count + 1 ) * 2 > t->mask + 1 )
+                t = grow( s );
+            const entry* e = store( s, str, hash );
+            insert( t, e );
+            return interned( e );
+        }
+        interned intern( const char* first, const char* last )
+        {
+            return intern( u8string_view( first, last ) );
+        }
+
+        // handle of str if it is interned, an empty handle otherwise (never inserts, lock-free)
+        interned find( u8string_view str ) const
+        {
+            uint64_t hash  = hash_of( str );
+            const shard& s = m_shards[hash & ( Shards - 1 )];
+            return interned( find( s.current.load( std::memory_order_acquire ), str, hash ) );
+        }
+
+        // handle for an id taken from a handle of this pool. Ids are not published in order, so
+        // while other threads intern an id below size( ) may still give an empty handle
+        interned at( uint32_t id ) const
+        {
+            size_t chunk, offset;
+            locate( id, chunk, offset );
+            const id_slot* slots = m_ids[chunk].load( std::memory_order_acquire );
+            return interned( slots ? slots[offset].load( std::memory_order_acquire ) : nullptr );
+        }
+
+        // number of distinct strings published so far (not the highest id in use)
+        size_t size( ) const
+        {
+            return m_count.load( std::memory_order_acquire );
+        }
+
+    private:
+        struct table
+        {
+            explicit table( size_t slots )
+                : mask( slots - 1 ), count( 0 ), slots( new std::atomic<const entry*>[slots] )
+            {
+                for ( size_t i = 0; i < slots; i++ )
+                {
+                    this->slots[i].store( nullptr, std::memory_order_relaxed );
+                }
+            }
+            ~table( )
+            {
+                delete[] slots;
+            }
+            size_t mask;
+            size_t count;
+            std::atomic<const entry*>* slots;
+        };
+
+        struct shard
+        {
+            shard( ) : current( nullptr ), storage( 64 * 1024 )
+            {
+            }
+            std::atomic<table*> current;
+            std::vector<table*> tables; // current one last, older ones kept for readers
+            std::mutex mutex;
+            arena storage;
+            struct_padding<CacheSize> padding;
+        };
+
+        // the low bits pick the shard, the ones above them the slot
+        static uint64_t hash_of( u8string_view str )
+        {
+            return dmk::hash( str );
+        }
+
+        static size_t slot_of( uint64_t hash, size_t mask )
+        {
+            return size_t( hash >> ShardBits ) & mask;
+        }
+
+        static const entry* find( const table* t, u8string_view str, uint64_t hash )
+        {
+            for ( size_t i = slot_of( hash, t->mask );; i = ( i + 1 ) & t->mask )
+            {
+                const entry* e = t->slots[i].load( std::memory_order_acquire );
+                if ( !e )
+                    return nullptr;
+                if ( e->hash == hash && e->size == str.size( ) &&
+                     std::memcmp( e->data( ), str.data( ), str.size( ) ) == 0 )
+                    return e;
+            }
+        }
+
+        static void insert( table* t, const entry* e )
+        {
+            size_t i = slot_of( e->hash, t->mask );
+            while ( t->slots[i].load( std::memory_order_relaxed ) )
+            {
+                i = ( i + 1 ) & t->mask;
+            }
+            t->slots[i].store( e, std::memory_order_release );
+            t->count++;
+        }
+
+        // called with the shard locked
+        table* grow( shard& s )
+        {
+            table* old   = s.current.load( std::memory_order_relaxed );
+            table* fresh = new table( ( old->mask + 1 ) * 2 );
+            for ( size_t i = 0; i <= old->mask; i++ )
+            {
+                if ( const entry* e = old->slots[i].load( std::memory_order_relaxed ) )
+                    insert( fresh, e );
+            }
+            s.tables.push_back( fresh );
+            s.current.store( fresh, std::memory_order_release );
+            return fresh;
+        }
+
+        // called with the shard locked
+        const entry* store( shard& s, u8string_view str, uint64_t hash )
+        {
+            size_type bytes = sizeof( entry ) + str.size( ) + 1;
+            entry* e        = ( entry* )s.storage.allocate( bytes );
+            if ( !e )
+                throw std::bad_alloc( );
+            char* data = reinterpret_cast<char*>( e + 1 );
+            std::memcpy( data, str.data( ), str.size( ) );
+            data[str.size( )] = 0;
+            e->hash           = hash;
+            e->size           = uint32_t( str.size( ) );
+            // ids are handed out under different shard locks, so the counter is atomic
+            e->id = m_next_id.fetch_add( 1, std::memory_order_relaxed );
+            publish_id( e );
+            return e;
+        }
+
+        typedef arena::size_type size_type;
+        typedef std::atomic<const entry*> id_slot;
+
+        static void locate( uint32_t id, size_t& chunk, size_t& offset )
+        {
+            size_t block = ( size_t( id ) >> IdChunkBits ) + 1;
+            chunk        = bit_scan_reverse( block );
+            offset       = size_t( id ) - ( ( ( size_t( 1 ) << chunk ) - 1 ) << IdChunkBits );
+        }
+
+        // makes e reachable through at( e->id ), chunks are created by whichever thread needs them first
+        void publish_id( const entry* e )
+        {
+            size_t chunk, offset;
+            locate( e->id, chunk, offset );
+            id_slot* slots = m_ids[chunk].load( std::memory_order_acquire );
+            if ( !slots )
+            {
+                size_t count   = size_t( 1 ) << ( chunk + IdChunkBits );
+                id_slot* fresh = new id_slot[count];
+                for ( size_t i = 0; i < count; i++ )
+                {
+                    fresh[i].store( nullptr, std::memory_order_relaxed );
+                }
+                if ( m_ids[chunk].compare_exchange_strong( slots, fresh, std::memory_order_acq_rel ) )
+                    slots = fresh;
+                else
+                    delete[] fresh;
+            }
+            slots[offset].store( e, std::memory_order_release );
+            m_count.fetch_add( 1, std::memory_order_release );
+        }
+
+        shard m_shards[Shards];
+        std::atomic<id_slot*> m_ids[IdChunks];
+        std::atomic<uint32_t> m_next_id{ 0 };
+        std::atomic<size_t> m_count;
+    };
+} // namespace dmk
+
+namespace std
+{
+    template <>
+    struct hash<dmk::interned>
+    {
+        size_t operator( )( const dmk::interned& str ) const
+        {
+            return size_t( str.hash( ) );
+        }
+    };
+} // namespace std
@@ -3,9 +3,41 @@
 #include "dmk.h"
 #include "dmk_assert.h"
 #include <memory>
+#include <new>
 #include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <cstdlib>
+#include <cstring>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#if defined( DMK_ARCH_AVX )
+#include <immintrin.h>
+#endif
 #if defined( DMK_OS_WIN )
 #include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#if defined( DMK_OS_LINUX )
+#include <sys/syscall.h>
+#endif
+
+#if defined( __has_include )
+#if __has_include( <memory_resource> ) && ( __cplusplus >= 201703L || _MSVC_LANG >= 201703L )
+#include <memory_resource>
+#define DMK_HAS_MEMORY_RESOURCE 1
+#endif
 #endif
 
 namespace dmk
@@ -28,6 +60,42 @@ namespace dmk
             _mm_free( memory );
     }
 
+    // Size of the last level cache (8 MB if it can not be detected)
+    inline size_t last_level_cache_size( )
+    {
+        static const size_t size = []( ) -> size_t {
+#if defined( DMK_OS_WIN )
+            DWORD length = 0;
+            ::GetLogicalProcessorInformation( NULL, &length );
+            std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(
+                length / sizeof( SYSTEM_LOGICAL_PROCESSOR_INFORMATION ) );
+            size_t result = 0;
+            BYTE level    = 0;
+            if ( !info.empty( ) && ::GetLogicalProcessorInformation( info.data( ), &length ) )
+            {
+                for ( const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& item : info )
+                {
+                    if ( item.Relationship == RelationCache && item.Cache.Level >= level )
+                    {
+                        level  = item.Cache.Level;
+                        result = item.Cache.Size;
+                    }
+                }
+            }
+            return result ? result : 8 * 1024 * 1024;
+#else
+            long result = 0;
+#if defined( _SC_LEVEL3_CACHE_SIZE )
+            result = ::sysconf( _SC_LEVEL3_CACHE_SIZE );
+            if ( result <= 0 )
+                result = ::sysconf( _SC_LEVEL2_CACHE_SIZE );
+#endif
+            return result > 0 ? size_t( result ) : 8 * 1024 * 1024;
+#endif
+        }( );
+        return size;
+    }
+
     struct allocator_base
     {
     public:
@@ -47,24 +115,177 @@ namespace dmk
         {
             return ( size + alignment - 1 ) & ~( alignment - 1 );
         }
+        // Regions larger than the last level cache are written with non-temporal stores
+        // to keep the working set in cache
         static void zeroize( pointer begin, pointer end )
         {
-            std::memset( begin, 0, ( size_t )end - ( size_t )begin );
+            size_t size = ( size_t )end - ( size_t )begin;
+            if ( size > last_level_cache_size( ) )
+            {
+                const uint8_t zero = 0;
+                fill_pattern<1, true>( ( uint8_t* )begin, ( uint8_t* )end, &zero );
+                return;
+            }
+            std::memset( begin, 0, size );
         }
         static void move( const_pointer begin, const_pointer end, pointer destination )
         {
-            std::memmove( destination, begin, ( size_t )end - ( size_t )begin );
+            size_t size = ( size_t )end - ( size_t )begin;
+            if ( size > last_level_cache_size( ) &&
+                 ( ( uint8_t* )destination + size <= begin || destination >= end ) )
+            {
+                stream_copy( ( const uint8_t* )begin, size, ( uint8_t* )destination );
+                return;
+            }
+            std::memmove( destination, begin, size );
         }
+        // Fills [begin, end) with copies of the itemsize bytes at source
         template <size_t itemsize>
         static void fill( pointer begin, pointer end, const_pointer source )
         {
-            for ( ; begin != end; begin++ )
+            size_t size = ( size_t )end - ( size_t )begin;
+            if ( size > last_level_cache_size( ) )
+            {
+                fill_pattern<itemsize, true>( ( uint8_t* )begin, ( uint8_t* )end, ( const uint8_t* )source );
+            }
+            else
             {
-                std::memmove( begin, source, itemsize );
+                fill_pattern<itemsize, false>( ( uint8_t* )begin, ( uint8_t* )end, ( const uint8_t* )source );
             }
         }
 
-    public:
+    private:
+#if defined( DMK_ARCH_AVX )
+        typedef __m256i simd_vector;
+        enum
+        {
+            SimdSize = 32
+        };
+        DMK_ALWAYS_INLINE_STATIC simd_vector simd_load( const void* source )
+        {
+            return _mm256_loadu_si256( ( const simd_vector* )source );
+        }
+        DMK_ALWAYS_INLINE_STATIC void simd_store( void* destination, simd_vector value )
+        {
+            _mm256_store_si256( ( simd_vector* )destination, value );
+        }
+        DMK_ALWAYS_INLINE_STATIC void simd_stream( void* destination, simd_vector value )
+        {
+            _mm256_stream_si256( ( simd_vector* )destination, value );
+        }
+#else
+        typedef __m128i simd_vector;
+        enum
+        {
+            SimdSize = 16
+        };
+        DMK_ALWAYS_INLINE_STATIC simd_vector simd_load( const void* source )
+        {
+            return _mm_loadu_si128( ( const simd_vector* )source );
+        }
+        DMK_ALWAYS_INLINE_STATIC void simd_store( void* destination, simd_vector value )
+        {
+            _mm_store_si128( ( simd_vector* )destination, value );
+        }
+        DMK_ALWAYS_INLINE_STATIC void simd_stream( void* destination, simd_vector value )
+        {
+            _mm_stream_si128( ( simd_vector* )destination, value );
+        }
+#endif
+
+        static DMK_CONSTEXPR_FUNC size_t gcd( size_t a, size_t b )
+        {
+            return b ? gcd( b, a % b ) : a;
+        }
+
+        // the pattern repeats every Period bytes, which is a whole number of vectors
+        template <size_t itemsize, bool streaming>
+        static void fill_pattern( uint8_t* begin, uint8_t* end, const uint8_t* source )
+        {
+            enum : size_t
+            {
+                Period  = itemsize / gcd( itemsize, SimdSize ) * SimdSize,
+                Vectors = Period / SimdSize
+            };
+            size_t size = end - begin;
+            if ( Vectors > 8 || size < Period + SimdSize )
+            {
+                fill_doubling<itemsize>( begin, size, source );
+                return;
+            }
+            uint8_t* aligned = ( uint8_t* )align_up<SimdSize>( ( size_t )begin );
+            size_t head      = aligned - begin;
+            for ( size_t i = 0; i < head; i++ )
+            {
+                begin[i] = source[i % itemsize];
+            }
+            // pattern as seen from the first aligned address
+            uint8_t block[Period];
+            for ( size_t i = 0; i < Period; i++ )
+            {
+                block[i] = source[( head + i ) % itemsize];
+            }
+            simd_vector pattern[Vectors];
+            for ( size_t v = 0; v < Vectors; v++ )
+            {
+                pattern[v] = simd_load( block + v * SimdSize );
+            }
+            uint8_t* current = aligned;
+            for ( ; current + Period <= end; current += Period )
+            {
+                for ( size_t v = 0; v < Vectors; v++ )
+                {
+                    if ( streaming )
+                        simd_stream( current + v * SimdSize, pattern[v] );
+                    else
+                        simd_store( current + v * SimdSize, pattern[v] );
+                }
+            }
+            if ( streaming )
+            {
+                _mm_sfence( );
+            }
+            std::memcpy( current, block, end - current );
+        }
+
+        // for patterns that do not fit in a few vectors: copy what is already filled
+        template <size_t itemsize>
+        static void fill_doubling( uint8_t* begin, size_t size, const uint8_t* source )
+        {
+            if ( size <= itemsize )
+            {
+                std::memcpy( begin, source, size );
+                return;
+            }
+            std::memcpy( begin, source, itemsize );
+            size_t filled = itemsize;
+            while ( filled * 2 <= size )
+            {
+                std::memcpy( begin + filled, begin, filled );
+                filled *= 2;
+            }
+            std::memcpy( begin + filled, begin, size - filled );
+        }
+
+        static void stream_copy( const uint8_t* source, size_t size, uint8_t* destination )
+        {
+            size_t head = align_up<SimdSize>( ( size_t )destination ) - ( size_t )destination;
+            std::memcpy( destination, source, head );
+            size_t i = head;
+            for ( ; i + 4 * SimdSize <= size; i += 4 * SimdSize )
+            {
+                simd_vector v0 = simd_load( source + i );
+                simd_vector v1 = simd_load( source + i + SimdSize );
+                simd_vector v2 = simd_load( source + i + 2 * SimdSize );
+                simd_vector v3 = simd_load( source + i + 3 * SimdSize );
+                simd_stream( destination + i, v0 );
+                simd_stream( destination + i + SimdSize, v1 );
+                simd_stream( destination + i + 2 * SimdSize, v2 );
+                simd_stream( destination + i + 3 * SimdSize, v3 );
+            }
+            _mm_sfence( );
+            std::memcpy( destination + i, source + i, size - i );
+        }
     };
 
     struct malloc_allocator : public allocator_base
@@ -77,9 +298,8 @@ namespace dmk
         }
         static zeroed_pointer allocate_zeroed( size_type& size )
         {
-            zeroed_pointer memory = allocate( size );
-            zeroize( memory, ( uint8_t* )memory + size );
-            return memory;
+            size = align_up<sizeof( size_t )>( size );
+            return std::calloc( size, 1 );
         }
         static void deallocate( pointer memory )
         {
@@ -95,21 +315,354 @@ namespace dmk
         AVXSize   = 32
     };
 
+    // Value followed by struct_padding up to the next whole cache line
+    template <typename _Type, size_t Padding = ( CacheSize - sizeof( _Type ) % CacheSize ) % CacheSize>
+    struct _cache_line_storage
+    {
+        template <typename... _Args>
+        explicit _cache_line_storage( _Args&&... args ) : value( std::forward<_Args>( args )... )
+        {
+        }
+        _Type value;
+        struct_padding<Padding> padding;
+    };
+
+    template <typename _Type>
+    struct _cache_line_storage<_Type, 0>
+    {
+        template <typename... _Args>
+        explicit _cache_line_storage( _Args&&... args ) : value( std::forward<_Args>( args )... )
+        {
+        }
+        _Type value;
+    };
+
+    // Value padded to occupy whole cache lines, so neighbours in an array never share a line
+    template <typename _Type>
+    struct alignas( CacheSize ) cache_aligned
+    {
+    public:
+        cache_aligned( ) : m_storage( )
+        {
+        }
+        // constructs the value from the arguments (never used for copies of a cache_aligned)
+        template <typename _Arg,
+                  typename... _Args,
+                  typename = typename std::enable_if<
+                      sizeof...( _Args ) != 0 ||
+                      !std::is_same<typename std::decay<_Arg>::type, cache_aligned>::value>::type>
+        explicit cache_aligned( _Arg&& arg, _Args&&... args )
+            : m_storage( std::forward<_Arg>( arg ), std::forward<_Args>( args )... )
+        {
+        }
+        cache_aligned( const cache_aligned& ) = default;
+        cache_aligned( cache_aligned&& )      = default;
+        cache_aligned& operator=( const cache_aligned& ) = default;
+        cache_aligned& operator=( cache_aligned&& ) = default;
+
+        _Type& get( )
+        {
+            return m_storage.value;
+        }
+        const _Type& get( ) const
+        {
+            return m_storage.value;
+        }
+        _Type& operator*( )
+        {
+            return m_storage.value;
+        }
+        const _Type& operator*( ) const
+        {
+            return m_storage.value;
+        }
+        _Type* operator->( )
+        {
+            return &m_storage.value;
+        }
+        const _Type* operator->( ) const
+        {
+            return &m_storage.value;
+        }
+
+    private:
+        _cache_line_storage<_Type> m_storage;
+    };
+
     enum
     {
-        PageAllocationGranularity = 65536
+        PageAllocationGranularity = DMK_IF_WIN( 65536, PageSize ),
+        HugePageSize              = 2 * 1024 * 1024
     };
 
-    DMK_ALIGNED_ALLOCATOR( PageSize ) void* paged_malloc( size_t size )
+    // Define DMK_PAGED_HUGE_PAGES before including this header to back paged allocations
+    // of HugePageSize and more with 2 MB pages (falls back to regular pages if unavailable)
+
+#if defined( DMK_OS_WIN )
+
+    DMK_ALIGNED_ALLOCATOR( PageSize ) inline void* paged_malloc( size_t size )
     {
+#if defined( DMK_PAGED_HUGE_PAGES )
+        size_t large_page = ::GetLargePageMinimum( );
+        if ( large_page && size >= HugePageSize )
+        {
+            void* memory = ::VirtualAlloc( NULL,
+                                           ( size + large_page - 1 ) & ~( large_page - 1 ),
+                                           MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                           PAGE_READWRITE );
+            if ( memory )
+                return memory;
+        }
+#endif
         return ::VirtualAlloc( NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
     }
 
-    void paged_free( void* memory )
+    inline void paged_free( void* memory )
+    {
+        ::VirtualFree( ( PVOID )memory, 0, MEM_RELEASE );
+    }
+
+    // Resizes a paged_malloc block, contents are copied up to the smaller size
+    inline void* paged_realloc( void* memory, size_t size )
+    {
+        if ( !memory )
+            return paged_malloc( size );
+        MEMORY_BASIC_INFORMATION info;
+        if ( !::VirtualQuery( memory, &info, sizeof( info ) ) )
+            return nullptr;
+        void* fresh = paged_malloc( size );
+        if ( !fresh )
+            return nullptr;
+        std::memcpy( fresh, memory, info.RegionSize < size ? info.RegionSize : size );
+        paged_free( memory );
+        return fresh;
+    }
+
+    // Pages aligned to a power of two alignment, the caller keeps track of the size
+    inline void* aligned_pages_malloc( size_t size, size_t alignment )
+    {
+        for ( int attempt = 0; attempt < 8; attempt++ )
+        {
+            // reserve a larger range to find an aligned address, then map exactly there
+            uint8_t* range = ( uint8_t* )::VirtualAlloc( NULL, size + alignment, MEM_RESERVE, PAGE_NOACCESS );
+            if ( !range )
+                return nullptr;
+            ::VirtualFree( range, 0, MEM_RELEASE );
+            void* aligned = ( void* )( ( ( size_t )range + alignment - 1 ) & ~( alignment - 1 ) );
+            void* memory  = ::VirtualAlloc( aligned, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+            if ( memory )
+                return memory;
+        }
+        return nullptr;
+    }
+
+    inline void aligned_pages_free( void* memory, size_t )
     {
         ::VirtualFree( ( PVOID )memory, 0, MEM_RELEASE );
     }
 
+    // Address space only, nothing is accessible until committed
+    inline void* pages_reserve( size_t size )
+    {
+        return ::VirtualAlloc( NULL, size, MEM_RESERVE, PAGE_NOACCESS );
+    }
+
+    inline bool pages_commit( void* memory, size_t size )
+    {
+        return ::VirtualAlloc( memory, size, MEM_COMMIT, PAGE_READWRITE ) != NULL;
+    }
+
+    // Gives the physical pages back, the range stays reserved
+    inline void pages_decommit( void* memory, size_t size )
+    {
+        ::VirtualFree( memory, size, MEM_DECOMMIT );
+    }
+
+    inline void pages_release( void* memory, size_t )
+    {
+        ::VirtualFree( memory, 0, MEM_RELEASE );
+    }
+
+#else
+
+    // munmap needs the mapping size, so every regular mapping starts with one header page
+    // and the caller gets the memory right after it. Huge page mappings are returned as is
+    // (2 MB aligned, no header page that would add a whole huge page) and their sizes are
+    // kept in a side table instead
+    struct paged_header
+    {
+        void* base;
+        size_t size;
+    };
+
+    inline void* _paged_map( size_t size, int flags )
+    {
+        void* memory =
+            ::mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0 );
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    // Pages aligned to a power of two alignment, the caller keeps track of the size
+    inline void* aligned_pages_malloc( size_t size, size_t alignment )
+    {
+        uint8_t* memory = ( uint8_t* )_paged_map( size + alignment, 0 );
+        if ( !memory )
+            return nullptr;
+        uint8_t* aligned = ( uint8_t* )( ( ( size_t )memory + alignment - 1 ) & ~( alignment - 1 ) );
+        if ( aligned != memory )
+            ::munmap( memory, aligned - memory );
+        if ( aligned + size != memory + size + alignment )
+            ::munmap( aligned + size, memory + alignment - aligned );
+        return aligned;
+    }
+
+    inline void aligned_pages_free( void* memory, size_t size )
+    {
+        ::munmap( memory, size );
+    }
+
+    // Address space only, nothing is accessible until committed
+    inline void* pages_reserve( size_t size )
+    {
+        void* memory = ::mmap( NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    inline bool pages_commit( void* memory, size_t size )
+    {
+        return ::mprotect( memory, size, PROT_READ | PROT_WRITE ) == 0;
+    }
+
+    // Gives the physical pages back, the range stays reserved
+    inline void pages_decommit( void* memory, size_t size )
+    {
+        ::madvise( memory, size, MADV_DONTNEED );
+        ::mprotect( memory, size, PROT_NONE );
+    }
+
+    inline void pages_release( void* memory, size_t size )
+    {
+        ::munmap( memory, size );
+    }
+
+    inline void* _paged_init( void* base, size_t size )
+    {
+        paged_header* header = ( paged_header* )base;
+        header->base         = base;
+        header->size         = size;
+        return ( uint8_t* )base + PageSize;
+    }
+
+#if defined( DMK_PAGED_HUGE_PAGES )
+    // huge mapping -> size, huge allocations are few so a locked map is cheap enough
+    struct _paged_huge_table
+    {
+        std::mutex mutex;
+        std::unordered_map<void*, size_t> sizes;
+
+        static _paged_huge_table& instance( )
+        {
+            static _paged_huge_table table;
+            return table;
+        }
+    };
+
+    inline void* _paged_huge_init( void* base, size_t size )
+    {
+        _paged_huge_table& table = _paged_huge_table::instance( );
+        std::lock_guard<std::mutex> lock( table.mutex );
+        table.sizes[base] = size;
+        return base;
+    }
+#endif
+
+    // Mapping behind a paged_malloc pointer, removed from the huge page table if take is set
+    inline paged_header _paged_mapping( void* memory, bool take )
+    {
+        ( void )take;
+#if defined( DMK_PAGED_HUGE_PAGES )
+        // regular blocks are never 2 MB aligned relative to their mapping, but their pointer can
+        // happen to be, so the table has the final say
+        if ( ( ( size_t )memory & ( HugePageSize - 1 ) ) == 0 )
+        {
+            _paged_huge_table& table = _paged_huge_table::instance( );
+            std::lock_guard<std::mutex> lock( table.mutex );
+            auto it = table.sizes.find( memory );
+            if ( it != table.sizes.end( ) )
+            {
+                paged_header mapping = { memory, it->second };
+                if ( take )
+                    table.sizes.erase( it );
+                return mapping;
+            }
+        }
+#endif
+        return *( const paged_header* )( ( uint8_t* )memory - PageSize );
+    }
+
+    DMK_ALIGNED_ALLOCATOR( PageSize ) inline void* paged_malloc( size_t size )
+    {
+#if defined( DMK_PAGED_HUGE_PAGES )
+        if ( size >= HugePageSize )
+        {
+            size_t huge_total = ( size + HugePageSize - 1 ) & ~size_t( HugePageSize - 1 );
+#if defined( MAP_HUGETLB )
+            // explicit huge pages (requires reserved pages in vm.nr_hugepages)
+            if ( void* memory = _paged_map( huge_total, MAP_HUGETLB ) )
+                return _paged_huge_init( memory, huge_total );
+#endif
+            // transparent huge pages: 2 MB aligned mapping, then ask for THP
+            if ( void* memory = aligned_pages_malloc( huge_total, HugePageSize ) )
+            {
+#if defined( MADV_HUGEPAGE )
+                ::madvise( memory, huge_total, MADV_HUGEPAGE );
+#endif
+                return _paged_huge_init( memory, huge_total );
+            }
+        }
+#endif
+        size_t total = ( ( size + PageSize - 1 ) & ~size_t( PageSize - 1 ) ) + PageSize;
+        if ( void* memory = _paged_map( total, 0 ) )
+            return _paged_init( memory, total );
+        return nullptr;
+    }
+
+    inline void paged_free( void* memory )
+    {
+        if ( !memory )
+            return;
+        paged_header mapping = _paged_mapping( memory, true );
+        ::munmap( mapping.base, mapping.size );
+    }
+
+    // Resizes a paged_malloc block, contents are kept up to the smaller size.
+    // On Linux the pages are remapped (no copy), the block may move
+    inline void* paged_realloc( void* memory, size_t size )
+    {
+        if ( !memory )
+            return paged_malloc( size );
+        paged_header mapping = _paged_mapping( memory, false );
+#if defined( DMK_OS_LINUX )
+        // huge page mappings (no header page) are copied, they can not always be remapped
+        if ( mapping.base != memory )
+        {
+            size_t total = ( ( size + PageSize - 1 ) & ~size_t( PageSize - 1 ) ) + PageSize;
+            void* base   = ::mremap( mapping.base, mapping.size, total, MREMAP_MAYMOVE );
+            if ( base != MAP_FAILED )
+                return _paged_init( base, total );
+        }
+#endif
+        void* fresh = paged_malloc( size );
+        if ( !fresh )
+            return nullptr;
+        size_t old_size = mapping.size - ( ( uint8_t* )memory - ( uint8_t* )mapping.base );
+        std::memcpy( fresh, memory, old_size < size ? old_size : size );
+        paged_free( memory );
+        return fresh;
+    }
+
+#endif
+
     template <size_t alignment>
     struct aligned_allocator : public allocator_base
     {
@@ -140,6 +693,160 @@ namespace dmk
             size = align_up<PageAllocationGranularity>( size );
             return paged_malloc( size );
         }
+        // fresh pages are always zeroed by the OS
+        static zeroed_pointer allocate_zeroed( size_type& size )
+        {
+            return allocate( size );
+        }
+        static void deallocate( pointer memory )
+        {
+            paged_free( memory );
+        }
+    };
+    enum class numa_policy
+    {
+        first_touch, // pages land on the node of the thread that touches them first
+        bind,        // pages are allocated on the given node only
+        interleave   // pages are spread round-robin across all allowed nodes
+    };
+
+#if defined( DMK_OS_LINUX )
+
+    // raw syscalls, so libnuma is not needed (values from linux/mempolicy.h)
+    enum
+    {
+        _MPOL_DEFAULT        = 0,
+        _MPOL_BIND           = 2,
+        _MPOL_INTERLEAVE     = 3,
+        _MPOL_LOCAL          = 4,
+        _MPOL_MF_MOVE        = 1 << 1,
+        _MPOL_F_NODE         = 1 << 0,
+        _MPOL_F_ADDR         = 1 << 1,
+        _MPOL_F_MEMS_ALLOWED = 1 << 2,
+        _NUMA_MAX_NODES      = 1024
+    };
+
+    typedef unsigned long _numa_mask[_NUMA_MAX_NODES / ( 8 * sizeof( unsigned long ) )];
+
+    inline bool _numa_allowed_nodes( _numa_mask& mask )
+    {
+        std::memset( mask, 0, sizeof( mask ) );
+        return ::syscall(
+                   SYS_get_mempolicy, NULL, mask, _NUMA_MAX_NODES + 1, NULL, _MPOL_F_MEMS_ALLOWED ) == 0;
+    }
+
+#endif
+
+    // Number of NUMA nodes memory can be placed on (1 if NUMA is not available)
+    inline int numa_node_count( )
+    {
+        static const int count = []( ) -> int {
+#if defined( DMK_OS_LINUX )
+            _numa_mask mask;
+            if ( !_numa_allowed_nodes( mask ) )
+                return 1;
+            int highest = 0;
+            for ( size_t i = 0; i < countof( mask ); i++ )
+            {
+                if ( mask[i] )
+                    highest = int( i * 8 * sizeof( unsigned long ) + bit_scan_reverse( mask[i] ) );
+            }
+            return highest + 1;
+#elif defined( DMK_OS_WIN )
+            ULONG highest = 0;
+            return ::GetNumaHighestNodeNumber( &highest ) ? int( highest ) + 1 : 1;
+#else
+            return 1;
+#endif
+        }( );
+        return count;
+    }
+
+    // Sets the placement policy of a page-aligned range that has not been touched yet.
+    // Returns false if the policy could not be applied, the memory stays usable in any case
+    inline bool numa_apply( void* memory, size_t size, numa_policy policy, int node = 0 )
+    {
+        // on a single node machine every policy is already satisfied
+        if ( numa_node_count( ) < 2 )
+            return true;
+        if ( policy == numa_policy::bind && ( node < 0 || node >= numa_node_count( ) ) )
+            return false;
+#if defined( DMK_OS_LINUX )
+        _numa_mask mask;
+        int mode;
+        switch ( policy )
+        {
+        case numa_policy::bind:
+            std::memset( mask, 0, sizeof( mask ) );
+            mask[node / ( 8 * sizeof( unsigned long ) )] = 1ul << ( node % ( 8 * sizeof( unsigned long ) ) );
+            mode = _MPOL_BIND;
+            break;
+        case numa_policy::interleave:
+            if ( !_numa_allowed_nodes( mask ) )
+                return false;
+            mode = _MPOL_INTERLEAVE;
+            break;
+        default:
+            if ( ::syscall( SYS_mbind, memory, size, _MPOL_LOCAL, NULL, 0, 0 ) == 0 )
+                return true;
+            // MPOL_LOCAL is not known to kernels before 3.8
+            return ::syscall( SYS_mbind, memory, size, _MPOL_DEFAULT, NULL, 0, 0 ) == 0;
+        }
+        return ::syscall( SYS_mbind, memory, size, mode, mask, _NUMA_MAX_NODES + 1, _MPOL_MF_MOVE ) == 0;
+#else
+        ( void )memory;
+        ( void )size;
+        return policy == numa_policy::first_touch;
+#endif
+    }
+
+    // Node the page containing the address is allocated on, -1 if unknown
+    inline int numa_node_of( const void* memory )
+    {
+#if defined( DMK_OS_LINUX )
+        int node = -1;
+        if ( ::syscall( SYS_get_mempolicy, &node, NULL, 0, memory, _MPOL_F_NODE | _MPOL_F_ADDR ) != 0 )
+            return -1;
+        return node;
+#elif defined( DMK_OS_WIN )
+        PSAPI_WORKING_SET_EX_INFORMATION info;
+        info.VirtualAddress = const_cast<void*>( memory );
+        if ( !::QueryWorkingSetEx( ::GetCurrentProcess( ), &info, sizeof( info ) ) ||
+             !info.VirtualAttributes.Valid )
+            return -1;
+        return int( info.VirtualAttributes.Node );
+#else
+        return numa_node_count( ) == 1 ? 0 : -1;
+#endif
+    }
+
+    // Page allocator with NUMA placement: numa_allocator<numa_policy::bind, 1>
+    template <numa_policy policy, int node = 0>
+    struct numa_allocator : public allocator_base
+    {
+    public:
+        static pointer allocate( size_type& size )
+        {
+            size = align_up<PageAllocationGranularity>( size );
+#if defined( DMK_OS_WIN )
+            if ( policy == numa_policy::bind && numa_node_count( ) > 1 )
+            {
+                return ::VirtualAllocExNuma( ::GetCurrentProcess( ),
+                                             NULL,
+                                             size,
+                                             MEM_RESERVE | MEM_COMMIT,
+                                             PAGE_READWRITE,
+                                             DWORD( node ) );
+            }
+#endif
+            pointer memory = paged_malloc( size );
+            if ( memory )
+            {
+                numa_apply( memory, size, policy, node );
+            }
+            return memory;
+        }
+        // fresh pages are always zeroed by the OS
         static zeroed_pointer allocate_zeroed( size_type& size )
         {
             return allocate( size );
@@ -149,4 +856,2645 @@ namespace dmk
             paged_free( memory );
         }
     };
+
+    // Bump allocator: memory is taken from large chunks and released all at once by rewind( )
+    struct arena
+    {
+    public:
+        typedef allocator_base::size_type size_type;
+        typedef allocator_base::pointer pointer;
+
+        enum
+        {
+            DefaultChunkSize = 1024 * 1024
+        };
+
+    private:
+        struct chunk
+        {
+            chunk* prev;
+            uint8_t* end;
+        };
+
+    public:
+        struct marker
+        {
+        public:
+            marker( ) : m_chunk( nullptr ), m_current( nullptr )
+            {
+            }
+
+        private:
+            friend struct arena;
+            marker( chunk* c, uint8_t* current ) : m_chunk( c ), m_current( current )
+            {
+            }
+            chunk* m_chunk;
+            uint8_t* m_current;
+        };
+
+    public:
+        explicit arena( size_type chunk_size = DefaultChunkSize )
+            : m_chunk( nullptr ), m_spare( nullptr ), m_current( nullptr ), m_end( nullptr ),
+              m_chunk_size( allocator_base::align_up<PageSize>( chunk_size ) )
+        {
+        }
+        arena( const arena& ) = delete;
+        arena& operator=( const arena& ) = delete;
+        ~arena( )
+        {
+            release( );
+        }
+
+        pointer allocate( size_type& size )
+        {
+            size = allocator_base::align_up<SSESize>( size );
+            if ( size > size_type( m_end - m_current ) || !m_current )
+            {
+                grow( size );
+            }
+            pointer memory = m_current;
+            m_current += size;
+            return memory;
+        }
+
+        // current position, pass to rewind( ) to free everything allocated after it
+        marker mark( ) const
+        {
+            return marker( m_chunk, m_current );
+        }
+
+        void rewind( const marker& m )
+        {
+            while ( m_chunk != m.m_chunk )
+            {
+                chunk* prev = m_chunk->prev;
+                free_chunk( m_chunk );
+                m_chunk = prev;
+            }
+            m_current = m.m_current;
+            m_end     = m_chunk ? m_chunk->end : nullptr;
+        }
+
+        // returns all chunks to the page allocator
+        void release( )
+        {
+            rewind( marker( ) );
+            if ( m_spare )
+            {
+                aligned_allocator<PageSize>::deallocate( m_spare );
+                m_spare = nullptr;
+            }
+        }
+
+    private:
+        static size_type header_size( )
+        {
+            return allocator_base::align_up<SSESize>( sizeof( chunk ) );
+        }
+
+        DMK_NOINLINE void grow( size_type size )
+        {
+            size_type chunk_size = m_chunk_size;
+            if ( size + header_size( ) > chunk_size )
+            {
+                chunk_size = size + header_size( );
+            }
+            chunk* c;
+            if ( m_spare && chunk_size == m_chunk_size )
+            {
+                c       = m_spare;
+                m_spare = nullptr;
+            }
+            else
+            {
+                c = ( chunk* )aligned_allocator<PageSize>::allocate( chunk_size );
+                if ( !c )
+                    throw std::bad_alloc( );
+                c->end = ( uint8_t* )c + chunk_size;
+            }
+            c->prev   = m_chunk;
+            m_chunk   = c;
+            m_current = ( uint8_t* )c + header_size( );
+            m_end     = c->end;
+        }
+
+        void free_chunk( chunk* c )
+        {
+            // keep one regular chunk around so that a scope loop does not map/unmap every time
+            if ( !m_spare && size_type( c->end - ( uint8_t* )c ) == m_chunk_size )
+            {
+                m_spare = c;
+            }
+            else
+            {
+                aligned_allocator<PageSize>::deallocate( c );
+            }
+        }
+
+        chunk* m_chunk;
+        chunk* m_spare;
+        uint8_t* m_current;
+        uint8_t* m_end;
+        size_type m_chunk_size;
+    };
+
+    // Allocates from the calling thread's arena, deallocate is a no-op.
+    // Memory is freed when the enclosing arena_allocator::scope ends:
+    //     arena_allocator::scope request_scope;
+    //     ... allocate per-request data ...
+    struct arena_allocator : public allocator_base
+    {
+    public:
+        static arena& current( )
+        {
+            static thread_local arena thread_arena;
+            return thread_arena;
+        }
+        static pointer allocate( size_type& size )
+        {
+            return current( ).allocate( size );
+        }
+        static zeroed_pointer allocate_zeroed( size_type& size )
+        {
+            zeroed_pointer memory = allocate( size );
+            zeroize( memory, ( uint8_t* )memory + size );
+            return memory;
+        }
+        static void deallocate( pointer )
+        {
+        }
+
+        // rewinds the arena to its position at construction
+        struct scope
+        {
+        public:
+            explicit scope( arena& a = current( ) ) : m_arena( a ), m_marker( a.mark( ) )
+            {
+            }
+            scope( const scope& ) = delete;
+            scope& operator=( const scope& ) = delete;
+            ~scope( )
+            {
+                m_arena.rewind( m_marker );
+            }
+
+        private:
+            arena& m_arena;
+            arena::marker m_marker;
+        };
+    };
+    struct pool_stats
+    {
+        size_t slabs;
+        size_t used;
+        size_t capacity;
+    };
+
+    // Fixed-size object pool. Slots are carved out of slabs taken from aligned_allocator<PageSize>,
+    // every page of a slab starts with a pointer to the slab header so deallocate can find it.
+    // Free slots form an intrusive list inside the slab, empty slabs go back to the page allocator.
+    template <size_t ObjectSize, size_t Alignment = sizeof( size_t )>
+    struct object_pool
+    {
+    public:
+        typedef allocator_base::size_type size_type;
+        typedef allocator_base::pointer pointer;
+
+        enum
+        {
+            SlotSize = ( ( ObjectSize < sizeof( void* ) ? sizeof( void* ) : ObjectSize ) + Alignment - 1 ) &
+                       ~( Alignment - 1 ),
+            SlabSize = 16 * PageSize
+        };
+
+    private:
+        struct free_slot
+        {
+            free_slot* next;
+        };
+
+        struct slab
+        {
+            slab* self; // must be first: same position as the page tag on the other pages
+            object_pool* pool;
+            slab* prev;
+            slab* next;
+            slab* all_prev;
+            slab* all_next;
+            free_slot* free;
+            uint8_t* bump;
+            size_type used;
+            size_type capacity;
+        };
+
+        // the header and the page tags are both padded to a cache line, so the slots of every page
+        // start on a line boundary and lay out the same way
+        enum
+        {
+            HeaderSize = ( sizeof( slab ) + CacheSize - 1 ) & ~( CacheSize - 1 ),
+            TagSize    = ( sizeof( slab* ) + CacheSize - 1 ) & ~( CacheSize - 1 )
+        };
+
+        static_assert( ( Alignment & ( Alignment - 1 ) ) == 0, "Alignment must be a power of two" );
+        static_assert( Alignment <= CacheSize, "Alignment must not exceed CacheSize" );
+        static_assert( HeaderSize + SlotSize <= PageSize, "ObjectSize is too large for a pool slab" );
+
+    public:
+        object_pool( ) : m_partial( nullptr ), m_empty( nullptr ), m_all( nullptr ), m_slabs( 0 ), m_used( 0 )
+        {
+        }
+        object_pool( const object_pool& ) = delete;
+        object_pool& operator=( const object_pool& ) = delete;
+        ~object_pool( )
+        {
+            release( );
+        }
+
+        pointer allocate( )
+        {
+            slab* s = m_partial;
+            if ( !s )
+            {
+                s = new_slab( );
+                if ( !s )
+                    return nullptr;
+            }
+            pointer memory;
+            if ( s->free )
+            {
+                memory  = s->free;
+                s->free = s->free->next;
+            }
+            else
+            {
+                memory = s->bump;
+                s->bump += SlotSize;
+                // skip to the next page when the slot does not fit the rest of this one
+                size_t offset = ( size_t )s->bump & ( PageSize - 1 );
+                if ( offset == 0 || offset + SlotSize > PageSize )
+                {
+                    s->bump = ( uint8_t* )allocator_base::align_up<PageSize>( ( size_t )s->bump ) + TagSize;
+                }
+            }
+            s->used++;
+            m_used++;
+            if ( s->used == s->capacity )
+            {
+                unlink( s );
+            }
+            return memory;
+        }
+
+        static void deallocate( pointer memory )
+        {
+            if ( !memory )
+                return;
+            slab* s = *( slab** )allocator_base::align_down<PageSize>( ( size_t )memory );
+            s->pool->free( s, memory );
+        }
+
+        pool_stats stats( ) const
+        {
+            return pool_stats{ m_slabs, m_used, m_slabs * capacity( ) };
+        }
+
+        double occupancy( ) const
+        {
+            return m_slabs ? double( m_used ) / double( m_slabs * capacity( ) ) : 0.0;
+        }
+
+        // slots per slab
+        static size_type capacity( )
+        {
+            return ( PageSize - HeaderSize ) / SlotSize +
+                   ( SlabSize / PageSize - 1 ) * ( ( PageSize - TagSize ) / SlotSize );
+        }
+
+        // frees every slab, including those with live objects
+        void release( )
+        {
+            while ( m_all )
+            {
+                slab* next = m_all->all_next;
+                aligned_allocator<PageSize>::deallocate( m_all );
+                m_all = next;
+            }
+            m_partial = nullptr;
+            m_empty   = nullptr;
+            m_slabs   = 0;
+            m_used    = 0;
+        }
+
+    private:
+        slab* new_slab( )
+        {
+            slab* s = m_empty;
+            if ( s )
+            {
+                m_empty = nullptr;
+            }
+            else
+            {
+                size_type size = SlabSize;
+                uint8_t* page  = ( uint8_t* )aligned_allocator<PageSize>::allocate( size );
+                if ( !page )
+                    return nullptr;
+                for ( size_type offset = PageSize; offset < SlabSize; offset += PageSize )
+                {
+                    *( slab** )( page + offset ) = ( slab* )page;
+                }
+                s           = ( slab* )page;
+                s->self     = s;
+                s->pool     = this;
+                s->capacity = capacity( );
+                s->all_prev = nullptr;
+                s->all_next = m_all;
+                if ( m_all )
+                    m_all->all_prev = s;
+                m_all = s;
+                m_slabs++;
+            }
+            s->free = nullptr;
+            s->bump = ( uint8_t* )s + HeaderSize;
+            s->used = 0;
+            link( s );
+            return s;
+        }
+
+        void free( slab* s, pointer memory )
+        {
+            DMK_ASSERT_EQ( s->pool, this );
+            free_slot* slot = ( free_slot* )memory;
+            slot->next      = s->free;
+            s->free         = slot;
+            if ( s->used == s->capacity )
+            {
+                link( s );
+            }
+            s->used--;
+            m_used--;
+            if ( s->used == 0 )
+            {
+                unlink( s );
+                // keep one empty slab to avoid map/unmap on alloc/free ping-pong
+                if ( !m_empty )
+                {
+                    m_empty = s;
+                }
+                else
+                {
+                    if ( s->all_prev )
+                        s->all_prev->all_next = s->all_next;
+                    else
+                        m_all = s->all_next;
+                    if ( s->all_next )
+                        s->all_next->all_prev = s->all_prev;
+                    m_slabs--;
+                    aligned_allocator<PageSize>::deallocate( s );
+                }
+            }
+        }
+
+        void link( slab* s )
+        {
+            s->prev = nullptr;
+            s->next = m_partial;
+            if ( m_partial )
+                m_partial->prev = s;
+            m_partial = s;
+        }
+
+        void unlink( slab* s )
+        {
+            if ( s->prev )
+                s->prev->next = s->next;
+            else
+                m_partial = s->next;
+            if ( s->next )
+                s->next->prev = s->prev;
+        }
+
+        slab* m_partial;
+        slab* m_empty;
+        slab* m_all;
+        size_type m_slabs;
+        size_type m_used;
+    };
+
+    // Allocates fixed-size slots from the calling thread's object_pool.
+    // Memory must be freed on the thread that allocated it and must not outlive that thread.
+    template <size_t ObjectSize, size_t Alignment = sizeof( size_t )>
+    struct pool_allocator : public allocator_base
+    {
+    public:
+        typedef object_pool<ObjectSize, Alignment> pool_type;
+
+        static pool_type& current( )
+        {
+            static thread_local pool_type thread_pool;
+            return thread_pool;
+        }
+        static pointer allocate( size_type& size )
+        {
+            DMK_ASSERT_LE( size, size_type( ObjectSize ) );
+            size = pool_type::SlotSize;
+            return current( ).allocate( );
+        }
+        static zeroed_pointer allocate_zeroed( size_type& size )
+        {
+            zeroed_pointer memory = allocate( size );
+            zeroize( memory, ( uint8_t* )memory + size );
+            return memory;
+        }
+        static void deallocate( pointer memory )
+        {
+            pool_type::deallocate( memory );
+        }
+        static pool_stats stats( )
+        {
+            return current( ).stats( );
+        }
+    };
+    // General purpose allocator with size classes and per-thread heaps.
+    // Every thread allocates from its own segments without locking, blocks freed by other threads
+    // are pushed onto the owning segment's lock-free remote list and collected by the owner later.
+    // Segments of exited threads are abandoned and adopted by the next thread that needs one.
+    struct scalable_allocator : public allocator_base
+    {
+    public:
+        enum
+        {
+            SegmentSize  = 1024 * 1024,
+            MaxSmallSize = 32768,
+            ClassCount   = 40
+        };
+
+    private:
+        struct block
+        {
+            block* next;
+        };
+
+        struct heap;
+
+        struct segment
+        {
+            std::atomic<heap*> owner;
+            std::atomic<block*> remote;
+            segment* prev;
+            segment* next;
+            block* free;
+            uint8_t* bump;
+            uint8_t* end;
+            size_type block_size;
+            size_type used;
+            size_type size; // mapping size, large allocations only
+            uint32_t size_class;
+            bool large;
+        };
+
+        enum
+        {
+            HeaderSize = ( sizeof( segment ) + CacheSize - 1 ) & ~( CacheSize - 1 )
+        };
+
+        struct heap
+        {
+            segment* classes[ClassCount];
+        };
+
+        // abandons the thread's heap at thread exit
+        struct heap_guard
+        {
+            heap_guard( ) : h( nullptr )
+            {
+            }
+            ~heap_guard( )
+            {
+                if ( h )
+                {
+                    thread_heap( ) = nullptr;
+                    abandon( h );
+                }
+            }
+            heap* h;
+        };
+
+    public:
+        static size_type size_class( size_type size )
+        {
+            if ( size <= 128 )
+                return size ? ( size - 1 ) >> 4 : 0;
+            unsigned p = bit_scan_reverse( size - 1 );
+            return 8 + ( p - 7 ) * 4 + ( ( ( size - 1 ) >> ( p - 2 ) ) - 4 );
+        }
+
+        static size_type class_size( size_type size_class )
+        {
+            if ( size_class < 8 )
+                return ( size_class + 1 ) * 16;
+            size_type p = ( size_class - 8 ) / 4 + 7;
+            return ( ( size_class - 8 ) % 4 + 5 ) << ( p - 2 );
+        }
+
+        static pointer allocate( size_type& size )
+        {
+            if ( size > MaxSmallSize )
+            {
+                return allocate_large( size );
+            }
+            size_type c = size_class( size );
+            size        = class_size( c );
+            heap* h     = thread_heap( );
+            if ( !h )
+            {
+                h = create_heap( );
+                if ( !h )
+                    return nullptr;
+            }
+            segment* seg = h->classes[c];
+            if ( seg )
+            {
+                if ( block* b = seg->free )
+                {
+                    seg->free = b->next;
+                    seg->used++;
+                    return b;
+                }
+                if ( seg->bump + seg->block_size <= seg->end )
+                {
+                    pointer memory = seg->bump;
+                    seg->bump += seg->block_size;
+                    seg->used++;
+                    return memory;
+                }
+            }
+            return allocate_slow( h, c );
+        }
+
+        static zeroed_pointer allocate_zeroed( size_type& size )
+        {
+            zeroed_pointer memory = allocate( size );
+            if ( memory && size <= MaxSmallSize )
+            {
+                zeroize( memory, ( uint8_t* )memory + size );
+            }
+            return memory;
+        }
+
+        static void deallocate( pointer memory )
+        {
+            if ( !memory )
+                return;
+            segment* seg = ( segment* )align_down<SegmentSize>( ( size_t )memory );
+            if ( seg->large )
+            {
+                aligned_pages_free( seg, seg->size );
+                return;
+            }
+            heap* h = thread_heap( );
+            if ( h && seg->owner.load( std::memory_order_relaxed ) == h )
+            {
+                block* b  = ( block* )memory;
+                b->next   = seg->free;
+                seg->free = b;
+                if ( --seg->used == 0 && h->classes[seg->size_class] != seg )
+                {
+                    unlink( h, seg );
+                    aligned_pages_free( seg, SegmentSize );
+                }
+            }
+            else
+            {
+                // remote free: lock-free push, collected by the owner on its slow path
+                block* b    = ( block* )memory;
+                block* head = seg->remote.load( std::memory_order_relaxed );
+                do
+                {
+                    b->next = head;
+                } while ( !seg->remote.compare_exchange_weak(
+                    head, b, std::memory_order_release, std::memory_order_relaxed ) );
+            }
+        }
+
+    private:
+        static heap*& thread_heap( )
+        {
+            static thread_local heap* h = nullptr;
+            return h;
+        }
+
+        static bool& thread_guarded( )
+        {
+            static thread_local bool guarded = false;
+            return guarded;
+        }
+
+        static std::mutex& abandoned_mutex( )
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static segment*& abandoned( )
+        {
+            static segment* list = nullptr;
+            return list;
+        }
+
+        static std::atomic<size_type>& abandoned_count( )
+        {
+            static std::atomic<size_type> count( 0 );
+            return count;
+        }
+
+        DMK_NOINLINE static heap* create_heap( )
+        {
+            size_type size = sizeof( heap );
+            heap* h        = ( heap* )aligned_allocator<PageSize>::allocate_zeroed( size );
+            if ( !h )
+                return nullptr;
+            thread_heap( ) = h;
+            // allocations made while thread-local destructors run get an unguarded heap
+            if ( !thread_guarded( ) )
+            {
+                static thread_local heap_guard guard;
+                guard.h           = h;
+                thread_guarded( ) = true;
+            }
+            return h;
+        }
+
+        DMK_NOINLINE static pointer allocate_large( size_type& size )
+        {
+            size_type total = align_up<PageSize>( size + HeaderSize );
+            segment* seg    = ( segment* )aligned_pages_malloc( total, SegmentSize );
+            if ( !seg )
+                return nullptr;
+            seg->large = true;
+            seg->size  = total;
+            size       = total - HeaderSize;
+            return ( uint8_t* )seg + HeaderSize;
+        }
+
+        DMK_NOINLINE static pointer allocate_slow( heap* h, size_type c )
+        {
+            segment* first = h->classes[c];
+            segment* seg   = first;
+            while ( seg )
+            {
+                if ( seg->free || collect( seg ) )
+                {
+                    break;
+                }
+                if ( seg->bump + seg->block_size <= seg->end )
+                {
+                    pointer memory = seg->bump;
+                    seg->bump += seg->block_size;
+                    seg->used++;
+                    return memory;
+                }
+                // exhausted: rotate to the back of the list and try the next one
+                seg = seg->next;
+                if ( seg == first )
+                {
+                    seg = nullptr;
+                    break;
+                }
+                h->classes[c] = seg;
+            }
+            if ( !seg )
+            {
+                seg = adopt( h, c );
+            }
+            if ( !seg )
+            {
+                seg = ( segment* )aligned_pages_malloc( SegmentSize, SegmentSize );
+                if ( !seg )
+                    return nullptr;
+                new ( &seg->owner ) std::atomic<heap*>( h );
+                new ( &seg->remote ) std::atomic<block*>( nullptr );
+                seg->free       = nullptr;
+                seg->bump       = ( uint8_t* )seg + HeaderSize;
+                seg->end        = ( uint8_t* )seg + SegmentSize;
+                seg->block_size = class_size( c );
+                seg->used       = 0;
+                seg->size       = SegmentSize;
+                seg->size_class = uint32_t( c );
+                seg->large      = false;
+                link( h, seg );
+            }
+            h->classes[c] = seg;
+            if ( !seg->free )
+            {
+                pointer memory = seg->bump;
+                seg->bump += seg->block_size;
+                seg->used++;
+                return memory;
+            }
+            block* b  = seg->free;
+            seg->free = b->next;
+            seg->used++;
+            return b;
+        }
+
+        // moves blocks freed by other threads to the local free list
+        static bool collect( segment* seg )
+        {
+            block* b = seg->remote.exchange( nullptr, std::memory_order_acquire );
+            if ( !b )
+                return false;
+            block* last     = b;
+            size_type freed = 1;
+            while ( last->next )
+            {
+                last = last->next;
+                freed++;
+            }
+            last->next = seg->free;
+            seg->free  = b;
+            seg->used -= freed;
+            return true;
+        }
+
+        // circular doubly linked list per size class, head is the current segment
+        static void link( heap* h, segment* seg )
+        {
+            segment*& head = h->classes[seg->size_class];
+            if ( head )
+            {
+                seg->next        = head;
+                seg->prev        = head->prev;
+                head->prev->next = seg;
+                head->prev       = seg;
+            }
+            else
+            {
+                seg->next = seg;
+                seg->prev = seg;
+            }
+            head = seg;
+        }
+
+        static void unlink( heap* h, segment* seg )
+        {
+            segment*& head = h->classes[seg->size_class];
+            if ( seg->next == seg )
+            {
+                head = nullptr;
+            }
+            else
+            {
+                seg->prev->next = seg->next;
+                seg->next->prev = seg->prev;
+                if ( head == seg )
+                    head = seg->next;
+            }
+        }
+
+        static segment* adopt( heap* h, size_type c )
+        {
+            if ( abandoned_count( ).load( std::memory_order_relaxed ) == 0 )
+                return nullptr;
+            std::lock_guard<std::mutex> lock( abandoned_mutex( ) );
+            for ( segment** it = &abandoned( ); *it; it = &( *it )->next )
+            {
+                segment* seg = *it;
+                if ( seg->size_class == c )
+                {
+                    *it = seg->next;
+                    abandoned_count( ).fetch_sub( 1, std::memory_order_relaxed );
+                    seg->owner.store( h, std::memory_order_relaxed );
+                    collect( seg );
+                    link( h, seg );
+                    return seg;
+                }
+            }
+            return nullptr;
+        }
+
+        static void abandon( heap* h )
+        {
+            for ( size_type c = 0; c < ClassCount; c++ )
+            {
+                while ( segment* seg = h->classes[c] )
+                {
+                    unlink( h, seg );
+                    collect( seg );
+                    if ( seg->used == 0 )
+                    {
+                        aligned_pages_free( seg, SegmentSize );
+                        continue;
+                    }
+                    seg->owner.store( nullptr, std::memory_order_relaxed );
+                    std::lock_guard<std::mutex> lock( abandoned_mutex( ) );
+                    seg->next    = abandoned( );
+                    abandoned( ) = seg;
+                    abandoned_count( ).fetch_add( 1, std::memory_order_relaxed );
+                }
+            }
+            aligned_allocator<PageSize>::deallocate( h );
+        }
+    };
+
+    // Replaces global operator new/delete with a dmk allocator that can free any pointer it returned.
+    // Use once in a single translation unit: DMK_GLOBAL_NEW_DELETE( dmk::scalable_allocator )
+#define DMK_GLOBAL_NEW_DELETE( _Allocator )                                                                  \
+    void* operator new( size_t size )                                                                        \
+    {                                                                                                        \
+        void* memory = _Allocator::allocate( size );                                                         \
+        if ( !memory )                                                                                       \
+            throw std::bad_alloc( );                                                                         \
+        return memory;                                                                                       \
+    }                                                                                                        \
+    void* operator new[]( size_t size )                                                                      \
+    {                                                                                                        \
+        return operator new( size );                                                                         \
+    }                                                                                                        \
+    void* operator new( size_t size, const std::nothrow_t& ) DMK_NOEXCEPT                                    \
+    {                                                                                                        \
+        return _Allocator::allocate( size );                                                                 \
+    }                                                                                                        \
+    void* operator new[]( size_t size, const std::nothrow_t& ) DMK_NOEXCEPT                                  \
+    {                                                                                                        \
+        return _Allocator::allocate( size );                                                                 \
+    }                                                                                                        \
+    void operator delete( void* memory ) DMK_NOEXCEPT                                                        \
+    {                                                                                                        \
+        _Allocator::deallocate( memory );                                                                    \
+    }                                                                                                        \
+    void operator delete[]( void* memory ) DMK_NOEXCEPT                                                      \
+    {                                                                                                        \
+        _Allocator::deallocate( memory );                                                                    \
+    }                                                                                                        \
+    void operator delete( void* memory, size_t ) DMK_NOEXCEPT                                                \
+    {                                                                                                        \
+        _Allocator::deallocate( memory );                                                                    \
+    }                                                                                                        \
+    void operator delete[]( void* memory, size_t ) DMK_NOEXCEPT                                              \
+    {                                                                                                        \
+        _Allocator::deallocate( memory );                                                                    \
+    }                                                                                                        \
+    void operator delete( void* memory, const std::nothrow_t& ) DMK_NOEXCEPT                                 \
+    {                                                                                                        \
+        _Allocator::deallocate( memory );                                                                    \
+    }                                                                                                        \
+    void operator delete[]( void* memory, const std::nothrow_t& ) DMK_NOEXCEPT                               \
+    {                                                                                                        \
+        _Allocator::deallocate( memory );                                                                    \
+    }
+
+    // Guaranteed alignment of memory returned by a dmk allocator
+    template <typename _Allocator>
+    struct allocator_alignment : public std::integral_constant<size_t, alignof( std::max_align_t )>
+    {
+    };
+
+    template <size_t alignment>
+    struct allocator_alignment<aligned_allocator<alignment>>
+        : public std::integral_constant<size_t,
+                                        ( alignment > sizeof( size_t ) ? alignment : sizeof( size_t ) )>
+    {
+    };
+
+    template <>
+    struct allocator_alignment<arena_allocator> : public std::integral_constant<size_t, SSESize>
+    {
+    };
+
+    template <size_t ObjectSize, size_t Alignment>
+    struct allocator_alignment<pool_allocator<ObjectSize, Alignment>>
+        : public std::integral_constant<size_t, Alignment>
+    {
+    };
+
+    // Adapts a dmk allocator to the standard Allocator requirements:
+    //     std::vector<float, std_allocator<float, aligned_allocator<AVXSize>>> data;
+    template <typename _Type, typename _Allocator = malloc_allocator>
+    struct std_allocator
+    {
+    public:
+        typedef _Type value_type;
+        typedef _Type* pointer;
+        typedef const _Type* const_pointer;
+        typedef _Type& reference;
+        typedef const _Type& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type is_always_equal;
+
+        template <typename _Other>
+        struct rebind
+        {
+            typedef std_allocator<_Other, _Allocator> other;
+        };
+
+    public:
+        std_allocator( ) DMK_NOEXCEPT
+        {
+        }
+        template <typename _Other>
+        std_allocator( const std_allocator<_Other, _Allocator>& ) DMK_NOEXCEPT
+        {
+        }
+
+        _Type* allocate( size_type count )
+        {
+            static_assert( alignof( _Type ) <= allocator_alignment<_Allocator>::value,
+                           "Allocator alignment is too small for this type" );
+            if ( count > size_type( -1 ) / sizeof( _Type ) )
+            {
+                throw std::bad_alloc( );
+            }
+            typename _Allocator::size_type size = count * sizeof( _Type );
+            void* memory                        = _Allocator::allocate( size );
+            if ( !memory && size )
+            {
+                throw std::bad_alloc( );
+            }
+            return static_cast<_Type*>( memory );
+        }
+        void deallocate( _Type* memory, size_type ) DMK_NOEXCEPT
+        {
+            _Allocator::deallocate( memory );
+        }
+    };
+
+    template <typename _Type1, typename _Type2, typename _Allocator>
+    inline bool operator==( const std_allocator<_Type1, _Allocator>&,
+                            const std_allocator<_Type2, _Allocator>& )
+    {
+        return true;
+    }
+
+    template <typename _Type1, typename _Type2, typename _Allocator>
+    inline bool operator!=( const std_allocator<_Type1, _Allocator>&,
+                            const std_allocator<_Type2, _Allocator>& )
+    {
+        return false;
+    }
+
+    template <typename _Type, size_t alignment = AVXSize>
+    using aligned_vector = std::vector<_Type, std_allocator<_Type, aligned_allocator<alignment>>>;
+
+#if defined( DMK_HAS_MEMORY_RESOURCE )
+
+    // std::pmr::memory_resource backed by a dmk allocator:
+    //     std::pmr::vector<char> buffer( memory_resource_adapter<aligned_allocator<PageSize>>::instance( ) );
+    template <typename _Allocator>
+    struct memory_resource_adapter : public std::pmr::memory_resource
+    {
+    public:
+        static std::pmr::memory_resource* instance( )
+        {
+            static memory_resource_adapter resource;
+            return &resource;
+        }
+
+    private:
+        void* do_allocate( size_t bytes, size_t alignment ) override
+        {
+            if ( alignment > allocator_alignment<_Allocator>::value )
+            {
+                throw std::bad_alloc( );
+            }
+            typename _Allocator::size_type size = bytes;
+            void* memory                        = _Allocator::allocate( size );
+            if ( !memory && size )
+            {
+                throw std::bad_alloc( );
+            }
+            return memory;
+        }
+        void do_deallocate( void* memory, size_t, size_t ) override
+        {
+            _Allocator::deallocate( memory );
+        }
+        bool do_is_equal( const std::pmr::memory_resource& other ) const DMK_NOEXCEPT override
+        {
+            return this == &other || dynamic_cast<const memory_resource_adapter*>( &other ) != nullptr;
+        }
+    };
+
+#endif
+    // Allocation callsite, created once per DMK_ALLOCATE_HERE expansion
+    struct allocation_site
+    {
+    public:
+        allocation_site( const char* file, const char* func, int line )
+            : m_file( file ), m_func( func ), m_line( line ), m_allocations( 0 ), m_bytes( 0 ),
+              m_live_bytes( 0 )
+        {
+            std::lock_guard<std::mutex> lock( mutex( ) );
+            m_next  = list( );
+            list( ) = this;
+        }
+        allocation_site( const allocation_site& ) = delete;
+        allocation_site& operator=( const allocation_site& ) = delete;
+
+        const char* file( ) const
+        {
+            return m_file;
+        }
+        const char* func( ) const
+        {
+            return m_func;
+        }
+        int line( ) const
+        {
+            return m_line;
+        }
+        uint64_t allocations( ) const
+        {
+            return m_allocations.load( std::memory_order_relaxed );
+        }
+        uint64_t bytes( ) const
+        {
+            return m_bytes.load( std::memory_order_relaxed );
+        }
+        int64_t live_bytes( ) const
+        {
+            return m_live_bytes.load( std::memory_order_relaxed );
+        }
+
+        void allocated( size_t size )
+        {
+            m_allocations.fetch_add( 1, std::memory_order_relaxed );
+            m_bytes.fetch_add( size, std::memory_order_relaxed );
+            m_live_bytes.fetch_add( int64_t( size ), std::memory_order_relaxed );
+        }
+        void freed( size_t size )
+        {
+            m_live_bytes.fetch_sub( int64_t( size ), std::memory_order_relaxed );
+        }
+
+        template <typename _Fn>
+        static void for_each( _Fn&& fn )
+        {
+            std::lock_guard<std::mutex> lock( mutex( ) );
+            for ( const allocation_site* site = list( ); site; site = site->m_next )
+            {
+                fn( *site );
+            }
+        }
+
+    private:
+        static std::mutex& mutex( )
+        {
+            static std::mutex m;
+            return m;
+        }
+        static allocation_site*& list( )
+        {
+            static allocation_site* head = nullptr;
+            return head;
+        }
+
+        const char* m_file;
+        const char* m_func;
+        int m_line;
+        allocation_site* m_next;
+        std::atomic<uint64_t> m_allocations;
+        std::atomic<uint64_t> m_bytes;
+        std::atomic<int64_t> m_live_bytes;
+    };
+
+    // Callsite of the current expression, for tracking_allocator<...>::allocate( size, site )
+#define DMK_ALLOCATE_HERE                                                                                    \
+    ( []( const char* _func ) -> ::dmk::allocation_site& {                                                   \
+        static ::dmk::allocation_site _site( __FILE__, _func, __LINE__ );                                    \
+        return _site;                                                                                        \
+    }( DMK_FUNC_NAME ) )
+
+    struct allocation_stats
+    {
+        enum
+        {
+            HistogramBins = 64
+        };
+        uint64_t allocations;
+        uint64_t deallocations;
+        uint64_t allocated_bytes;
+        uint64_t freed_bytes;
+        int64_t live_bytes;
+        int64_t peak_bytes;
+        // histogram[i] counts allocations with size in [2^i, 2^(i+1))
+        uint64_t histogram[HistogramBins];
+    };
+
+    // Decorator that counts allocations of the inner allocator.
+    // Each thread updates its own counters (no atomic read-modify-write), stats( ) merges them.
+    // Live and peak bytes are published in 64 KB steps, so peak is exact to 64 KB per thread.
+    // Every block carries a small header with its size and callsite:
+    //     void* p = tracking_allocator<malloc_allocator>::allocate( size, DMK_ALLOCATE_HERE );
+    // The header sits in front of the block up to CacheSize alignment. Inner allocators with larger
+    // alignment (aligned_allocator<PageSize>, ...) would lose a whole alignment unit per block to it,
+    // so their headers are kept in a locked side table instead
+    template <typename _Inner>
+    struct tracking_allocator : public allocator_base
+    {
+    public:
+        enum
+        {
+            InnerAlignment = allocator_alignment<_Inner>::value,
+            SideHeaders    = InnerAlignment > CacheSize,
+            HeaderSize     = SideHeaders ? 0 : ( InnerAlignment < 16 ? 16 : InnerAlignment ),
+            PublishThreshold = 65536
+        };
+
+    private:
+        struct header
+        {
+            size_t size;
+            allocation_site* site;
+        };
+
+        typedef std::unordered_map<void*, header, std::hash<void*>, std::equal_to<void*>,
+                                   std_allocator<std::pair<void* const, header>>>
+            header_table;
+
+        struct counter : public std::atomic<uint64_t>
+        {
+            counter( ) : std::atomic<uint64_t>( 0 )
+            {
+            }
+            // only the owning thread writes to its slot, so load + store is enough there
+            void add( uint64_t value, bool shared )
+            {
+                if ( shared )
+                    fetch_add( value, std::memory_order_relaxed );
+                else
+                    store( load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+            }
+        };
+
+        struct alignas( CacheSize ) thread_slot
+        {
+            explicit thread_slot( bool overflow = false )
+                : in_use( true ), shared( overflow ), next( nullptr ), pending_live( 0 )
+            {
+            }
+            std::atomic<bool> in_use;
+            bool shared; // the overflow slot, written by any thread
+            thread_slot* next;
+            counter allocations;
+            counter deallocations;
+            counter allocated_bytes;
+            counter freed_bytes;
+            counter histogram[allocation_stats::HistogramBins];
+            std::atomic<int64_t> pending_live;
+        };
+
+        struct slot_guard
+        {
+            slot_guard( ) : slot( nullptr )
+            {
+            }
+            ~slot_guard( )
+            {
+                if ( slot )
+                {
+                    thread_current( ) = nullptr;
+                    publish( *slot );
+                    slot->in_use.store( false, std::memory_order_release );
+                }
+                // allocations from later thread_local destructors go to the overflow slot
+                thread_state( ) = Exited;
+            }
+            thread_slot* slot;
+        };
+
+    public:
+        static pointer allocate( size_type& size )
+        {
+            return allocate( size, nullptr );
+        }
+        static pointer allocate( size_type& size, allocation_site& site )
+        {
+            return allocate( size, &site );
+        }
+        static zeroed_pointer allocate_zeroed( size_type& size )
+        {
+            size_type inner_size = size + HeaderSize;
+            uint8_t* memory      = ( uint8_t* )_Inner::allocate_zeroed( inner_size );
+            return track( memory, inner_size, size, nullptr );
+        }
+        static void deallocate( pointer memory )
+        {
+            if ( !memory )
+                return;
+            uint8_t* block = ( uint8_t* )memory - HeaderSize;
+            header h       = take_header( block );
+            if ( h.site )
+            {
+                h.site->freed( h.size );
+            }
+            thread_slot& slot = current( );
+            slot.deallocations.add( 1, slot.shared );
+            slot.freed_bytes.add( h.size, slot.shared );
+            update_live( slot, -int64_t( h.size ) );
+            _Inner::deallocate( block );
+        }
+
+        // merged counters of all threads
+        static allocation_stats stats( )
+        {
+            allocation_stats result = {};
+            int64_t pending         = 0;
+            std::lock_guard<std::mutex> lock( slots_mutex( ) );
+            for ( thread_slot* slot = slots( ); slot; slot = slot->next )
+            {
+                result.allocations += slot->allocations.load( std::memory_order_relaxed );
+                result.deallocations += slot->deallocations.load( std::memory_order_relaxed );
+                result.allocated_bytes += slot->allocated_bytes.load( std::memory_order_relaxed );
+                result.freed_bytes += slot->freed_bytes.load( std::memory_order_relaxed );
+                for ( size_t i = 0; i < allocation_stats::HistogramBins; i++ )
+                {
+                    result.histogram[i] += slot->histogram[i].load( std::memory_order_relaxed );
+                }
+                pending += slot->pending_live.load( std::memory_order_relaxed );
+            }
+            result.live_bytes = live( ).load( std::memory_order_relaxed ) + pending;
+            result.peak_bytes = peak( ).load( std::memory_order_relaxed );
+            if ( result.live_bytes > result.peak_bytes )
+            {
+                result.peak_bytes = result.live_bytes;
+            }
+            return result;
+        }
+
+    private:
+        static pointer allocate( size_type& size, allocation_site* site )
+        {
+            size_type inner_size = size + HeaderSize;
+            uint8_t* memory      = ( uint8_t* )_Inner::allocate( inner_size );
+            return track( memory, inner_size, size, site );
+        }
+
+        static pointer track( uint8_t* memory, size_type inner_size, size_type& size, allocation_site* site )
+        {
+            if ( !memory )
+                return nullptr;
+            size = inner_size - HeaderSize;
+            if ( !put_header( memory, header{ size, site } ) )
+            {
+                _Inner::deallocate( memory );
+                return nullptr;
+            }
+            if ( site )
+            {
+                site->allocated( size );
+            }
+            thread_slot& slot = current( );
+            slot.allocations.add( 1, slot.shared );
+            slot.allocated_bytes.add( size, slot.shared );
+            slot.histogram[size ? bit_scan_reverse( size ) : 0].add( 1, slot.shared );
+            update_live( slot, int64_t( size ) );
+            return memory + HeaderSize;
+        }
+
+        static bool put_header( uint8_t* block, const header& h )
+        {
+            if ( !SideHeaders )
+            {
+                *( header* )block = h;
+                return true;
+            }
+            // the table allocates from malloc, so this also works as global operator new
+            std::lock_guard<std::mutex> lock( headers_mutex( ) );
+            try
+            {
+                headers( )[block] = h;
+            }
+            catch ( const std::bad_alloc& )
+            {
+                return false;
+            }
+            return true;
+        }
+
+        static header take_header( uint8_t* block )
+        {
+            if ( !SideHeaders )
+                return *( header* )block;
+            std::lock_guard<std::mutex> lock( headers_mutex( ) );
+            header_table& table = headers( );
+            auto it             = table.find( block );
+            DMK_ASSERT( it != table.end( ) );
+            header h = it->second;
+            table.erase( it );
+            return h;
+        }
+
+        static void update_live( thread_slot& slot, int64_t delta )
+        {
+            int64_t pending = delta;
+            if ( !slot.shared )
+                pending += slot.pending_live.load( std::memory_order_relaxed );
+            if ( slot.shared || pending >= PublishThreshold || pending <= -PublishThreshold )
+            {
+                slot.pending_live.store( 0, std::memory_order_relaxed );
+                int64_t total = live( ).fetch_add( pending, std::memory_order_relaxed ) + pending;
+                int64_t top   = peak( ).load( std::memory_order_relaxed );
+                while ( total > top &&
+                        !peak( ).compare_exchange_weak( top, total, std::memory_order_relaxed ) )
+                {
+                }
+            }
+            else
+            {
+                slot.pending_live.store( pending, std::memory_order_relaxed );
+            }
+        }
+
+        static void publish( thread_slot& slot )
+        {
+            int64_t pending = slot.pending_live.exchange( 0, std::memory_order_relaxed );
+            live( ).fetch_add( pending, std::memory_order_relaxed );
+        }
+
+        static thread_slot& current( )
+        {
+            thread_slot* slot = thread_current( );
+            return slot ? *slot : acquire( );
+        }
+
+        DMK_NOINLINE static thread_slot& acquire( )
+        {
+            // no slot of its own once the thread's guard is gone, it would never be released
+            if ( thread_state( ) == Exited )
+                return overflow( );
+            thread_slot* slot = nullptr;
+            {
+                std::lock_guard<std::mutex> lock( slots_mutex( ) );
+                // counters are cumulative, so a slot left by an exited thread can be reused as is
+                for ( thread_slot* it = slots( ); it; it = it->next )
+                {
+                    bool expected = false;
+                    if ( it->in_use.compare_exchange_strong( expected, true, std::memory_order_acquire ) )
+                    {
+                        slot = it;
+                        break;
+                    }
+                }
+                if ( !slot )
+                {
+                    // not from the inner allocator: this may be installed as global operator new
+                    void* memory = aligned_malloc<CacheSize>( sizeof( thread_slot ) );
+                    if ( !memory )
+                        return overflow_locked( );
+                    slot       = new ( memory ) thread_slot( );
+                    slot->next = slots( );
+                    slots( )   = slot;
+                }
+            }
+            thread_current( ) = slot;
+            if ( thread_state( ) == Unguarded )
+            {
+                static thread_local slot_guard guard;
+                guard.slot      = slot;
+                thread_state( ) = Guarded;
+            }
+            return *slot;
+        }
+
+        // shared slot for threads without one of their own (out of memory, or exiting)
+        static thread_slot& overflow( )
+        {
+            std::lock_guard<std::mutex> lock( slots_mutex( ) );
+            return overflow_locked( );
+        }
+        static thread_slot& overflow_locked( )
+        {
+            static thread_slot slot( true );
+            static bool linked = false;
+            if ( !linked )
+            {
+                slot.next = slots( );
+                slots( )  = &slot;
+                linked    = true;
+            }
+            return slot;
+        }
+
+        enum
+        {
+            Unguarded,
+            Guarded,
+            Exited
+        };
+
+        static thread_slot*& thread_current( )
+        {
+            static thread_local thread_slot* slot = nullptr;
+            return slot;
+        }
+        static int& thread_state( )
+        {
+            static thread_local int state = Unguarded;
+            return state;
+        }
+        static std::mutex& headers_mutex( )
+        {
+            static std::mutex m;
+            return m;
+        }
+        static header_table& headers( )
+        {
+            // never destroyed: blocks may still be freed during static destruction
+            static header_table* table = new ( std::malloc( sizeof( header_table ) ) ) header_table( );
+            return *table;
+        }
+        static std::mutex& slots_mutex( )
+        {
+            static std::mutex m;
+            return m;
+        }
+        static thread_slot*& slots( )
+        {
+            static thread_slot* head = nullptr;
+            return head;
+        }
+        static std::atomic<int64_t>& live( )
+        {
+            static std::atomic<int64_t> bytes( 0 );
+            return bytes;
+        }
+        static std::atomic<int64_t>& peak( )
+        {
+            static std::atomic<int64_t> bytes( 0 );
+            return bytes;
+        }
+    };
+
+    template <typename _Inner>
+    struct allocator_alignment<tracking_allocator<_Inner>> : public allocator_alignment<_Inner>
+    {
+    };
+    // Contiguous growable array aligned to Alignment.
+    // Small buffers come from aligned_allocator<Alignment>, from PagedThreshold bytes on the storage is
+    // paged and trivially copyable elements grow with paged_realloc (mremap on Linux) instead of a copy
+    template <typename _Type, size_t Alignment = AVXSize>
+    struct aligned_buffer
+    {
+    public:
+        typedef _Type value_type;
+        typedef _Type* pointer;
+        typedef const _Type* const_pointer;
+        typedef _Type& reference;
+        typedef const _Type& const_reference;
+        typedef _Type* iterator;
+        typedef const _Type* const_iterator;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        enum
+        {
+            PagedThreshold = 16 * PageSize
+        };
+
+        static_assert( Alignment >= alignof( _Type ), "Alignment is smaller than the alignment of the type" );
+
+    public:
+        aligned_buffer( ) DMK_NOEXCEPT : m_data( nullptr ), m_size( 0 ), m_capacity( 0 ), m_paged( false )
+        {
+        }
+        explicit aligned_buffer( size_type count ) : aligned_buffer( )
+        {
+            resize( count );
+        }
+        aligned_buffer( size_type count, const _Type& value ) : aligned_buffer( )
+        {
+            resize( count, value );
+        }
+        aligned_buffer( const aligned_buffer& other ) : aligned_buffer( )
+        {
+            reserve( other.m_size );
+            std::uninitialized_copy( other.begin( ), other.end( ), m_data );
+            m_size = other.m_size;
+        }
+        aligned_buffer( aligned_buffer&& other ) DMK_NOEXCEPT : m_data( other.m_data ),
+                                                                m_size( other.m_size ),
+                                                                m_capacity( other.m_capacity ),
+                                                                m_paged( other.m_paged )
+        {
+            other.m_data     = nullptr;
+            other.m_size     = 0;
+            other.m_capacity = 0;
+            other.m_paged    = false;
+        }
+        aligned_buffer& operator=( const aligned_buffer& other )
+        {
+            if ( this != &other )
+            {
+                aligned_buffer copy( other );
+                swap( copy );
+            }
+            return *this;
+        }
+        aligned_buffer& operator=( aligned_buffer&& other ) DMK_NOEXCEPT
+        {
+            aligned_buffer moved( std::move( other ) );
+            swap( moved );
+            return *this;
+        }
+        ~aligned_buffer( )
+        {
+            clear( );
+            deallocate( m_data, m_paged );
+        }
+
+        void swap( aligned_buffer& other ) DMK_NOEXCEPT
+        {
+            std::swap( m_data, other.m_data );
+            std::swap( m_size, other.m_size );
+            std::swap( m_capacity, other.m_capacity );
+            std::swap( m_paged, other.m_paged );
+        }
+
+        pointer data( )
+        {
+            return m_data;
+        }
+        const_pointer data( ) const
+        {
+            return m_data;
+        }
+        size_type size( ) const
+        {
+            return m_size;
+        }
+        size_type capacity( ) const
+        {
+            return m_capacity;
+        }
+        bool empty( ) const
+        {
+            return m_size == 0;
+        }
+        iterator begin( )
+        {
+            return m_data;
+        }
+        iterator end( )
+        {
+            return m_data + m_size;
+        }
+        const_iterator begin( ) const
+        {
+            return m_data;
+        }
+        const_iterator end( ) const
+        {
+            return m_data + m_size;
+        }
+        reference operator[]( size_type index )
+        {
+            DMK_ASSERT_LT( index, m_size );
+            return m_data[index];
+        }
+        const_reference operator[]( size_type index ) const
+        {
+            DMK_ASSERT_LT( index, m_size );
+            return m_data[index];
+        }
+        reference front( )
+        {
+            return m_data[0];
+        }
+        reference back( )
+        {
+            return m_data[m_size - 1];
+        }
+
+        void reserve( size_type count )
+        {
+            if ( count > m_capacity )
+            {
+                reallocate( count );
+            }
+        }
+
+        void resize( size_type count )
+        {
+            grow_to( count );
+            for ( ; m_size < count; m_size++ )
+            {
+                new ( m_data + m_size ) _Type( );
+            }
+            shrink_to( count );
+        }
+
+        void resize( size_type count, const _Type& value )
+        {
+            if ( count > m_capacity )
+            {
+                // value may be an element of this buffer
+                _Type copy( value );
+                grow_to( count );
+                resize( count, copy );
+                return;
+            }
+            for ( ; m_size < count; m_size++ )
+            {
+                new ( m_data + m_size ) _Type( value );
+            }
+            shrink_to( count );
+        }
+
+        // new elements are left uninitialized
+        void resize_uninitialized( size_type count )
+        {
+            static_assert( std::is_trivially_default_constructible<_Type>::value &&
+                               std::is_trivially_destructible<_Type>::value,
+                           "resize_uninitialized requires a trivial type" );
+            grow_to( count );
+            m_size = count;
+        }
+
+        void push_back( const _Type& value )
+        {
+            emplace_back( value );
+        }
+        void push_back( _Type&& value )
+        {
+            emplace_back( std::move( value ) );
+        }
+        template <typename... _Args>
+        reference emplace_back( _Args&&... args )
+        {
+            if ( m_size == m_capacity )
+            {
+                return emplace_back_grow( std::forward<_Args>( args )... );
+            }
+            pointer item = new ( m_data + m_size ) _Type( std::forward<_Args>( args )... );
+            m_size++;
+            return *item;
+        }
+        void pop_back( )
+        {
+            DMK_ASSERT_GT( m_size, 0u );
+            m_data[--m_size].~_Type( );
+        }
+        void clear( )
+        {
+            shrink_to( 0 );
+        }
+
+    private:
+        // args may refer to an element, so the new one is built before the storage moves
+        template <typename... _Args>
+        DMK_NOINLINE reference emplace_back_grow( _Args&&... args )
+        {
+            _Type value( std::forward<_Args>( args )... );
+            reallocate( grow_capacity( m_size + 1 ) );
+            pointer item = new ( m_data + m_size ) _Type( std::move( value ) );
+            m_size++;
+            return *item;
+        }
+
+        size_type grow_capacity( size_type count ) const
+        {
+            size_type doubled = m_capacity * 2;
+            return doubled > count ? doubled : count;
+        }
+
+        void grow_to( size_type count )
+        {
+            if ( count > m_capacity )
+            {
+                reallocate( grow_capacity( count ) );
+            }
+        }
+
+        void shrink_to( size_type count )
+        {
+            for ( ; m_size > count; m_size-- )
+            {
+                m_data[m_size - 1].~_Type( );
+            }
+        }
+
+        static void deallocate( pointer memory, bool paged )
+        {
+            if ( paged )
+                paged_free( memory );
+            else
+                aligned_allocator<Alignment>::deallocate( memory );
+        }
+
+        void reallocate( size_type count )
+        {
+            if ( count > size_type( -1 ) / sizeof( _Type ) )
+            {
+                throw std::bad_alloc( );
+            }
+            size_type bytes = count * sizeof( _Type );
+            bool paged      = bytes >= PagedThreshold || Alignment >= PageSize;
+            pointer memory;
+            if ( paged )
+            {
+                bytes = allocator_base::align_up<PageSize>( bytes );
+                if ( m_paged && std::is_trivially_copyable<_Type>::value )
+                {
+                    // pages are moved, not copied
+                    memory = ( pointer )paged_realloc( m_data, bytes );
+                    if ( !memory )
+                        throw std::bad_alloc( );
+                    m_data     = memory;
+                    m_capacity = bytes / sizeof( _Type );
+                    return;
+                }
+                memory = ( pointer )paged_malloc( bytes );
+            }
+            else
+            {
+                memory = ( pointer )aligned_allocator<Alignment>::allocate( bytes );
+            }
+            if ( !memory )
+            {
+                throw std::bad_alloc( );
+            }
+            relocate( memory, std::is_trivially_copyable<_Type>( ) );
+            deallocate( m_data, m_paged );
+            m_data     = memory;
+            m_capacity = bytes / sizeof( _Type );
+            m_paged    = paged;
+        }
+
+        void relocate( pointer memory, std::true_type )
+        {
+            if ( m_size )
+            {
+                std::memcpy( memory, m_data, m_size * sizeof( _Type ) );
+            }
+        }
+
+        void relocate( pointer memory, std::false_type )
+        {
+            for ( size_type i = 0; i < m_size; i++ )
+            {
+                new ( memory + i ) _Type( std::move_if_noexcept( m_data[i] ) );
+                m_data[i].~_Type( );
+            }
+        }
+
+        pointer m_data;
+        size_type m_size;
+        size_type m_capacity;
+        bool m_paged;
+    };
+
+    // Growable array keeping the first N elements inside the object itself.
+    // The heap (any dmk allocator) is touched only when the size grows past N
+    template <typename _Type, size_t N, typename _Allocator = malloc_allocator>
+    struct small_vector
+    {
+    public:
+        typedef _Type value_type;
+        typedef _Type* pointer;
+        typedef const _Type* const_pointer;
+        typedef _Type& reference;
+        typedef const _Type& const_reference;
+        typedef _Type* iterator;
+        typedef const _Type* const_iterator;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        static_assert( N > 0, "small_vector needs inline storage for at least one element" );
+        static_assert( allocator_alignment<_Allocator>::value >= alignof( _Type ),
+                       "allocator alignment is smaller than the alignment of the type" );
+
+    public:
+        small_vector( ) DMK_NOEXCEPT : m_data( inline_data( ) ), m_size( 0 ), m_capacity( N )
+        {
+        }
+        explicit small_vector( size_type count ) : small_vector( )
+        {
+            resize( count );
+        }
+        small_vector( size_type count, const _Type& value ) : small_vector( )
+        {
+            resize( count, value );
+        }
+        small_vector( std::initializer_list<_Type> list ) : small_vector( )
+        {
+            assign( list.begin( ), list.end( ) );
+        }
+        template <typename _Iterator, typename = typename std::iterator_traits<_Iterator>::iterator_category>
+        small_vector( _Iterator first, _Iterator last ) : small_vector( )
+        {
+            assign( first, last );
+        }
+        small_vector( const small_vector& other ) : small_vector( )
+        {
+            assign( other.begin( ), other.end( ) );
+        }
+        small_vector( small_vector&& other ) DMK_NOEXCEPT_OP(
+            std::is_nothrow_move_constructible<_Type>::value )
+            : small_vector( )
+        {
+            take( other );
+        }
+        small_vector& operator=( const small_vector& other )
+        {
+            if ( this != &other )
+            {
+                assign( other.begin( ), other.end( ) );
+            }
+            return *this;
+        }
+        small_vector& operator=( small_vector&& other ) DMK_NOEXCEPT_OP(
+            std::is_nothrow_move_constructible<_Type>::value )
+        {
+            if ( this != &other )
+            {
+                clear( );
+                take( other );
+            }
+            return *this;
+        }
+        ~small_vector( )
+        {
+            clear( );
+            if ( !is_inline( ) )
+                _Allocator::deallocate( m_data );
+        }
+
+        template <typename _Iterator>
+        void assign( _Iterator first, _Iterator last )
+        {
+            clear( );
+            reserve( size_type( std::distance( first, last ) ) );
+            for ( ; first != last; ++first )
+            {
+                new ( m_data + m_size ) _Type( *first );
+                m_size++;
+            }
+        }
+
+        // true while the elements live in the inline storage
+        bool is_inline( ) const
+        {
+            return m_data == inline_data( );
+        }
+
+        pointer data( )
+        {
+            return m_data;
+        }
+        const_pointer data( ) const
+        {
+            return m_data;
+        }
+        size_type size( ) const
+        {
+            return m_size;
+        }
+        size_type capacity( ) const
+        {
+            return m_capacity;
+        }
+        bool empty( ) const
+        {
+            return m_size == 0;
+        }
+        iterator begin( )
+        {
+            return m_data;
+        }
+        iterator end( )
+        {
+            return m_data + m_size;
+        }
+        const_iterator begin( ) const
+        {
+            return m_data;
+        }
+        const_iterator end( ) const
+        {
+            return m_data + m_size;
+        }
+        reference operator[]( size_type index )
+        {
+            DMK_ASSERT_LT( index, m_size );
+            return m_data[index];
+        }
+        const_reference operator[]( size_type index ) const
+        {
+            DMK_ASSERT_LT( index, m_size );
+            return m_data[index];
+        }
+        reference front( )
+        {
+            return m_data[0];
+        }
+        const_reference front( ) const
+        {
+            return m_data[0];
+        }
+        reference back( )
+        {
+            return m_data[m_size - 1];
+        }
+        const_reference back( ) const
+        {
+            return m_data[m_size - 1];
+        }
+
+        void reserve( size_type count )
+        {
+            if ( count > m_capacity )
+            {
+                reallocate( count );
+            }
+        }
+
+        void resize( size_type count )
+        {
+            grow_to( count );
+            for ( ; m_size < count; m_size++ )
+            {
+                new ( m_data + m_size ) _Type( );
+            }
+            shrink_to( count );
+        }
+
+        void resize( size_type count, const _Type& value )
+        {
+            if ( count > m_capacity )
+            {
+                // value may be an element of this vector
+                _Type copy( value );
+                grow_to( count );
+                resize( count, copy );
+                return;
+            }
+            for ( ; m_size < count; m_size++ )
+            {
+                new ( m_data + m_size ) _Type( value );
+            }
+            shrink_to( count );
+        }
+
+        void push_back( const _Type& value )
+        {
+            emplace_back( value );
+        }
+        void push_back( _Type&& value )
+        {
+            emplace_back( std::move( value ) );
+        }
+        template <typename... _Args>
+        reference emplace_back( _Args&&... args )
+        {
+            if ( m_size == m_capacity )
+            {
+                return emplace_back_grow( std::forward<_Args>( args )... );
+            }
+            pointer item = new ( m_data + m_size ) _Type( std::forward<_Args>( args )... );
+            m_size++;
+            return *item;
+        }
+        void pop_back( )
+        {
+            DMK_ASSERT_GT( m_size, 0u );
+            m_data[--m_size].~_Type( );
+        }
+        iterator erase( const_iterator position )
+        {
+            iterator it = m_data + ( position - m_data );
+            std::move( it + 1, end( ), it );
+            pop_back( );
+            return it;
+        }
+        void clear( )
+        {
+            shrink_to( 0 );
+        }
+
+    private:
+        pointer inline_data( )
+        {
+            return reinterpret_cast<pointer>( &m_inline );
+        }
+        const_pointer inline_data( ) const
+        {
+            return reinterpret_cast<const_pointer>( &m_inline );
+        }
+
+        // args may refer to an element, so the new one is built before the storage moves
+        template <typename... _Args>
+        DMK_NOINLINE reference emplace_back_grow( _Args&&... args )
+        {
+            _Type value( std::forward<_Args>( args )... );
+            reallocate( m_capacity * 2 );
+            pointer item = new ( m_data + m_size ) _Type( std::move( value ) );
+            m_size++;
+            return *item;
+        }
+
+        void grow_to( size_type count )
+        {
+            if ( count > m_capacity )
+            {
+                reallocate( count > m_capacity * 2 ? count : m_capacity * 2 );
+            }
+        }
+
+        void shrink_to( size_type count )
+        {
+            for ( ; m_size > count; m_size-- )
+            {
+                m_data[m_size - 1].~_Type( );
+            }
+        }
+
+        void reallocate( size_type count )
+        {
+            if ( count > size_type( -1 ) / sizeof( _Type ) )
+            {
+                throw std::bad_alloc( );
+            }
+            size_type bytes = count * sizeof( _Type );
+            pointer memory  = ( pointer )_Allocator::allocate( bytes );
+            if ( !memory )
+            {
+                throw std::bad_alloc( );
+            }
+            for ( size_type i = 0; i < m_size; i++ )
+            {
+                new ( memory + i ) _Type( std::move_if_noexcept( m_data[i] ) );
+                m_data[i].~_Type( );
+            }
+            if ( !is_inline( ) )
+                _Allocator::deallocate( m_data );
+            m_data     = memory;
+            m_capacity = bytes / sizeof( _Type );
+        }
+
+        // moves the contents of other into this (empty) vector, stealing heap storage when possible
+        void take( small_vector& other )
+        {
+            if ( other.is_inline( ) )
+            {
+                for ( size_type i = 0; i < other.m_size; i++ )
+                {
+                    new ( m_data + i ) _Type( std::move( other.m_data[i] ) );
+                }
+                m_size = other.m_size;
+                other.clear( );
+                return;
+            }
+            if ( !is_inline( ) )
+                _Allocator::deallocate( m_data );
+            m_data           = other.m_data;
+            m_size           = other.m_size;
+            m_capacity       = other.m_capacity;
+            other.m_data     = other.inline_data( );
+            other.m_size     = 0;
+            other.m_capacity = N;
+        }
+
+        pointer m_data;
+        size_type m_size;
+        size_type m_capacity;
+        typename std::aligned_storage<sizeof( _Type ) * N, alignof( _Type )>::type m_inline;
+    };
+
+    template <typename _Type, size_t N, typename _Allocator>
+    inline bool operator==( const small_vector<_Type, N, _Allocator>& left,
+                            const small_vector<_Type, N, _Allocator>& right )
+    {
+        return left.size( ) == right.size( ) && std::equal( left.begin( ), left.end( ), right.begin( ) );
+    }
+
+    template <typename _Type, size_t N, typename _Allocator>
+    inline bool operator!=( const small_vector<_Type, N, _Allocator>& left,
+                            const small_vector<_Type, N, _Allocator>& right )
+    {
+        return !( left == right );
+    }
+
+    // Contiguous array that never moves: the address range for max_count elements is reserved up
+    // front and pages are committed as the array grows, so pointers stay valid and growth never copies.
+    // A default constructed array reserves DefaultReservation bytes when it first grows
+    template <typename _Type>
+    struct virtual_array
+    {
+    public:
+        typedef _Type value_type;
+        typedef _Type* pointer;
+        typedef const _Type* const_pointer;
+        typedef _Type& reference;
+        typedef const _Type& const_reference;
+        typedef _Type* iterator;
+        typedef const _Type* const_iterator;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        enum : size_t
+        {
+            // address space only, nothing is committed until used
+            DefaultReservation = sizeof( void* ) >= 8 ? size_t( 1 ) << 30 : size_t( 64 ) << 20
+        };
+
+        static_assert( alignof( _Type ) <= PageSize, "virtual_array can not align to more than a page" );
+
+    public:
+        virtual_array( ) DMK_NOEXCEPT : m_data( nullptr ), m_size( 0 ), m_committed( 0 ), m_reserved( 0 )
+        {
+        }
+        // reserves (but does not commit) address space for max_count elements
+        explicit virtual_array( size_type max_count ) : virtual_array( )
+        {
+            if ( max_count > ( size_type( -1 ) - PageAllocationGranularity ) / sizeof( _Type ) )
+            {
+                throw std::bad_alloc( );
+            }
+            reserve_range( max_count * sizeof( _Type ) );
+        }
+        virtual_array( const virtual_array& ) = delete;
+        virtual_array& operator=( const virtual_array& ) = delete;
+        virtual_array( virtual_array&& other ) DMK_NOEXCEPT : m_data( other.m_data ),
+                                                              m_size( other.m_size ),
+                                                              m_committed( other.m_committed ),
+                                                              m_reserved( other.m_reserved )
+        {
+            other.m_data      = nullptr;
+            other.m_size      = 0;
+            other.m_committed = 0;
+            other.m_reserved  = 0;
+        }
+        virtual_array& operator=( virtual_array&& other ) DMK_NOEXCEPT
+        {
+            virtual_array moved( std::move( other ) );
+            swap( moved );
+            return *this;
+        }
+        ~virtual_array( )
+        {
+            clear( );
+            if ( m_data )
+                pages_release( m_data, m_reserved );
+        }
+
+        void swap( virtual_array& other ) DMK_NOEXCEPT
+        {
+            std::swap( m_data, other.m_data );
+            std::swap( m_size, other.m_size );
+            std::swap( m_committed, other.m_committed );
+            std::swap( m_reserved, other.m_reserved );
+        }
+
+        pointer data( )
+        {
+            return m_data;
+        }
+        const_pointer data( ) const
+        {
+            return m_data;
+        }
+        size_type size( ) const
+        {
+            return m_size;
+        }
+        // elements that fit in the committed pages
+        size_type capacity( ) const
+        {
+            return m_committed / sizeof( _Type );
+        }
+        // elements that fit in the reserved range (DefaultReservation before a default constructed
+        // array first grows)
+        size_type max_size( ) const
+        {
+            return ( m_data ? m_reserved : size_type( DefaultReservation ) ) / sizeof( _Type );
+        }
+        bool empty( ) const
+        {
+            return m_size == 0;
+        }
+        iterator begin( )
+        {
+            return m_data;
+        }
+        iterator end( )
+        {
+            return m_data + m_size;
+        }
+        const_iterator begin( ) const
+        {
+            return m_data;
+        }
+        const_iterator end( ) const
+        {
+            return m_data + m_size;
+        }
+        reference operator[]( size_type index )
+        {
+            DMK_ASSERT_LT( index, m_size );
+            return m_data[index];
+        }
+        const_reference operator[]( size_type index ) const
+        {
+            DMK_ASSERT_LT( index, m_size );
+            return m_data[index];
+        }
+        reference front( )
+        {
+            return m_data[0];
+        }
+        reference back( )
+        {
+            return m_data[m_size - 1];
+        }
+
+        // commits pages for count elements up front
+        void reserve( size_type count )
+        {
+            commit( count );
+        }
+
+        void resize( size_type count )
+        {
+            commit( count );
+            for ( ; m_size < count; m_size++ )
+            {
+                new ( m_data + m_size ) _Type( );
+            }
+            shrink_to( count );
+        }
+
+        void resize( size_type count, const _Type& value )
+        {
+            commit( count );
+            for ( ; m_size < count; m_size++ )
+            {
+                new ( m_data + m_size ) _Type( value );
+            }
+            shrink_to( count );
+        }
+
+        void push_back( const _Type& value )
+        {
+            emplace_back( value );
+        }
+        void push_back( _Type&& value )
+        {
+            emplace_back( std::move( value ) );
+        }
+        template <typename... _Args>
+        reference emplace_back( _Args&&... args )
+        {
+            if ( ( m_size + 1 ) * sizeof( _Type ) > m_committed )
+            {
+                commit( m_size + 1 );
+            }
+            pointer item = new ( m_data + m_size ) _Type( std::forward<_Args>( args )... );
+            m_size++;
+            return *item;
+        }
+        void pop_back( )
+        {
+            DMK_ASSERT_GT( m_size, 0u );
+            m_data[--m_size].~_Type( );
+        }
+        void clear( )
+        {
+            shrink_to( 0 );
+        }
+
+        // decommits the pages past the last element, the range stays reserved
+        void shrink_to_fit( )
+        {
+            size_type used = allocator_base::align_up<PageAllocationGranularity>( m_size * sizeof( _Type ) );
+            if ( used < m_committed )
+            {
+                pages_decommit( ( uint8_t* )m_data + used, m_committed - used );
+                m_committed = used;
+            }
+        }
+
+    private:
+        void reserve_range( size_type bytes )
+        {
+            bytes  = allocator_base::align_up<PageAllocationGranularity>( bytes );
+            m_data = ( pointer )pages_reserve( bytes );
+            if ( !m_data )
+            {
+                throw std::bad_alloc( );
+            }
+            m_reserved = bytes;
+        }
+
+        // commits at least enough pages for count elements, growing the committed part
+        // geometrically (in PageAllocationGranularity steps) to keep the number of syscalls low
+        void commit( size_type count )
+        {
+            if ( count > max_size( ) )
+            {
+                throw std::bad_alloc( );
+            }
+            size_type bytes = count * sizeof( _Type );
+            if ( bytes <= m_committed )
+                return;
+            if ( !m_data )
+            {
+                reserve_range( DefaultReservation );
+            }
+            size_type target = m_committed * 2 > bytes ? m_committed * 2 : bytes;
+            target           = allocator_base::align_up<PageAllocationGranularity>( target );
+            if ( target > m_reserved )
+                target = m_reserved;
+            if ( !pages_commit( ( uint8_t* )m_data + m_committed, target - m_committed ) )
+            {
+                throw std::bad_alloc( );
+            }
+            m_committed = target;
+        }
+
+        void shrink_to( size_type count )
+        {
+            for ( ; m_size > count; m_size-- )
+            {
+                m_data[m_size - 1].~_Type( );
+            }
+        }
+
+        pointer m_data;
+        size_type m_size;
+        size_type m_committed; // bytes
+        size_type m_reserved;  // bytes
+    };
+
+    enum class map_access
+    {
+        read_only,
+        read_write // shared mapping, changes are written back to the file
+    };
+
+    enum class map_hint
+    {
+        normal,
+        sequential, // aggressive read-ahead, pages behind are dropped early
+        random,     // no read-ahead
+        willneed    // start reading the whole file in the background
+    };
+
+    // Memory-mapped file:
+    //     mapped_file file( "corpus.txt", map_access::read_only, map_hint::sequential );
+    //     u8string::const_iterator it = file.view<u8string::const_iterator>( );
+    struct mapped_file
+    {
+    public:
+        mapped_file( ) DMK_NOEXCEPT : m_data( nullptr ),
+                                      m_size( 0 ),
+                                      m_error( 0 ),
+                                      m_open( false ),
+                                      m_writable( false )
+        {
+#if defined( DMK_OS_WIN )
+            m_file    = INVALID_HANDLE_VALUE;
+            m_mapping = NULL;
+#endif
+        }
+        // populate: prefault all pages on open (MAP_POPULATE)
+        explicit mapped_file( const std::string& path,
+                              map_access access = map_access::read_only,
+                              map_hint hint     = map_hint::normal,
+                              bool populate     = false )
+            : mapped_file( )
+        {
+            open( path, access, hint, populate );
+        }
+        mapped_file( const mapped_file& ) = delete;
+        mapped_file& operator=( const mapped_file& ) = delete;
+        mapped_file( mapped_file&& other ) DMK_NOEXCEPT : mapped_file( )
+        {
+            swap( other );
+        }
+        mapped_file& operator=( mapped_file&& other ) DMK_NOEXCEPT
+        {
+            mapped_file moved( std::move( other ) );
+            swap( moved );
+            return *this;
+        }
+        ~mapped_file( )
+        {
+            close( );
+        }
+
+        void swap( mapped_file& other ) DMK_NOEXCEPT
+        {
+            std::swap( m_data, other.m_data );
+            std::swap( m_size, other.m_size );
+            std::swap( m_error, other.m_error );
+            std::swap( m_open, other.m_open );
+            std::swap( m_writable, other.m_writable );
+#if defined( DMK_OS_WIN )
+            std::swap( m_file, other.m_file );
+            std::swap( m_mapping, other.m_mapping );
+#endif
+        }
+
+        // returns false on failure, error( ) holds errno/GetLastError( )
+        bool open( const std::string& path,
+                   map_access access = map_access::read_only,
+                   map_hint hint     = map_hint::normal,
+                   bool populate     = false )
+        {
+            close( );
+            m_error       = 0;
+            bool writable = access == map_access::read_write;
+            m_writable    = writable; // reset by close( ) if opening fails
+#if defined( DMK_OS_WIN )
+            DWORD flags = 0;
+            if ( hint == map_hint::sequential )
+                flags = FILE_FLAG_SEQUENTIAL_SCAN;
+            else if ( hint == map_hint::random )
+                flags = FILE_FLAG_RANDOM_ACCESS;
+            m_file = ::CreateFileA( path.c_str( ),
+                                    writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                                    FILE_SHARE_READ | ( writable ? 0 : FILE_SHARE_WRITE ),
+                                    NULL,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | flags,
+                                    NULL );
+            if ( m_file == INVALID_HANDLE_VALUE )
+                return fail( );
+            LARGE_INTEGER size;
+            if ( !::GetFileSizeEx( m_file, &size ) )
+                return fail( );
+            m_size = size_t( size.QuadPart );
+            m_open = true;
+            if ( m_size == 0 )
+                return true;
+            m_mapping =
+                ::CreateFileMappingA( m_file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL );
+            if ( !m_mapping )
+                return fail( );
+            m_data =
+                ( char* )::MapViewOfFile( m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0 );
+            if ( !m_data )
+                return fail( );
+#if _WIN32_WINNT >= 0x0602
+            if ( populate || hint == map_hint::willneed )
+            {
+                WIN32_MEMORY_RANGE_ENTRY range = { m_data, m_size };
+                ::PrefetchVirtualMemory( ::GetCurrentProcess( ), 1, &range, 0 );
+            }
+#endif
+#else
+            int fd = ::open( path.c_str( ), writable ? O_RDWR : O_RDONLY );
+            if ( fd < 0 )
+                return fail( );
+            struct stat info;
+            if ( ::fstat( fd, &info ) != 0 )
+            {
+                fail( );
+                ::close( fd );
+                return false;
+            }
+            m_size = size_t( info.st_size );
+            m_open = true;
+            if ( m_size == 0 )
+            {
+                ::close( fd );
+                return true;
+            }
+            int flags = writable ? MAP_SHARED : MAP_PRIVATE;
+#if defined( MAP_POPULATE )
+            if ( populate )
+                flags |= MAP_POPULATE;
+#endif
+            int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+            void* memory   = ::mmap( NULL, m_size, protection, flags, fd, 0 );
+            ::close( fd );
+            if ( memory == MAP_FAILED )
+                return fail( );
+            m_data = ( char* )memory;
+            advise( hint );
+#endif
+            return true;
+        }
+
+        // changes the access pattern hint of an open mapping
+        void advise( map_hint hint )
+        {
+#if !defined( DMK_OS_WIN )
+            if ( !m_data )
+                return;
+            static const int advice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+            ::madvise( m_data, m_size, advice[int( hint )] );
+#endif
+        }
+
+        // writes changes of a read_write mapping back to the file
+        bool flush( )
+        {
+            if ( !m_data )
+                return true;
+#if defined( DMK_OS_WIN )
+            return ::FlushViewOfFile( m_data, 0 ) != 0;
+#else
+            return ::msync( m_data, m_size, MS_SYNC ) == 0;
+#endif
+        }
+
+        void close( )
+        {
+#if defined( DMK_OS_WIN )
+            if ( m_data )
+                ::UnmapViewOfFile( m_data );
+            if ( m_mapping )
+                ::CloseHandle( m_mapping );
+            if ( m_file != INVALID_HANDLE_VALUE )
+                ::CloseHandle( m_file );
+            m_mapping = NULL;
+            m_file    = INVALID_HANDLE_VALUE;
+#else
+            if ( m_data )
+                ::munmap( m_data, m_size );
+#endif
+            m_data     = nullptr;
+            m_size     = 0;
+            m_open     = false;
+            m_writable = false;
+        }
+
+        bool is_open( ) const
+        {
+            return m_open;
+        }
+        int error( ) const
+        {
+            return m_error;
+        }
+        // true for a read_write mapping
+        bool writable( ) const
+        {
+            return m_writable;
+        }
+        const char* data( ) const
+        {
+            return m_data;
+        }
+        // mutable contents, nullptr unless the file was opened read_write
+        char* writable_data( )
+        {
+            return m_writable ? m_data : nullptr;
+        }
+        const uint8_t* bytes( ) const
+        {
+            return ( const uint8_t* )m_data;
+        }
+        size_t size( ) const
+        {
+            return m_size;
+        }
+        bool empty( ) const
+        {
+            return m_size == 0;
+        }
+        const char* begin( ) const
+        {
+            return m_data;
+        }
+        const char* end( ) const
+        {
+            return m_data + m_size;
+        }
+
+        // contents as any view constructible from ( pointer, size ), no copy is made:
+        //     file.view<u8string::const_iterator>( ), file.view<std::string_view>( )
+        template <typename _View>
+        _View view( ) const
+        {
+            return _View( m_data, m_size );
+        }
+
+    private:
+        bool fail( )
+        {
+#if defined( DMK_OS_WIN )
+            m_error = int( ::GetLastError( ) );
+#else
+            m_error = errno;
+#endif
+            close( );
+            return false;
+        }
+
+        char* m_data;
+        size_t m_size;
+        int m_error;
+        bool m_open;
+        bool m_writable;
+#if defined( DMK_OS_WIN )
+        HANDLE m_file;
+        HANDLE m_mapping;
+#endif
+    };
 } // namespace dmk
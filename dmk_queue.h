@@ -0,0 +1,366 @@
+#pragma once
+
+#include "dmk.h"
+#include "dmk_memory.h"
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <thread>
+
+namespace dmk
+{
+    // Busy-wait step: pause first, give the core away if the other side is not running
+    inline void spin_wait( unsigned& spins )
+    {
+        if ( ++spins < 64 )
+            _mm_pause( );
+        else
+            std::this_thread::yield( );
+    }
+
+    // Bounded lock-free queue for exactly one producer thread and one consumer thread.
+    // Head and tail live on separate cache lines, each side keeps a cached copy of the other index
+    // so the shared line is only read when the queue looks full/empty.
+    template <typename _Type, typename _Allocator = aligned_allocator<CacheSize>>
+    struct spsc_queue
+    {
+    public:
+        typedef _Type value_type;
+        typedef size_t size_type;
+
+    public:
+        // capacity is rounded up to a power of two (at least 2)
+        explicit spsc_queue( size_type capacity )
+            : m_head( 0 ), m_tail_cache( 0 ), m_tail( 0 ), m_head_cache( 0 ),
+              m_mask( round_up_pow2( capacity < 2 ? 2 : capacity ) - 1 )
+        {
+            size_type size = ( m_mask + 1 ) * sizeof( _Type );
+            m_items        = ( _Type* )_Allocator::allocate( size );
+            if ( !m_items )
+                throw std::bad_alloc( );
+        }
+        spsc_queue( const spsc_queue& ) = delete;
+        spsc_queue& operator=( const spsc_queue& ) = delete;
+        ~spsc_queue( )
+        {
+            size_type tail = m_tail.load( std::memory_order_acquire );
+            for ( size_type head = m_head.load( std::memory_order_relaxed ); head != tail; head++ )
+            {
+                m_items[head & m_mask].~_Type( );
+            }
+            _Allocator::deallocate( m_items );
+        }
+
+        size_type capacity( ) const
+        {
+            return m_mask + 1;
+        }
+
+        // approximate when called concurrently
+        size_type size( ) const
+        {
+            return m_tail.load( std::memory_order_acquire ) - m_head.load( std::memory_order_acquire );
+        }
+        bool empty( ) const
+        {
+            return size( ) == 0;
+        }
+
+        // producer side
+
+        template <typename... _Args>
+        bool try_emplace( _Args&&... args )
+        {
+            size_type tail = m_tail.load( std::memory_order_relaxed );
+            if ( tail - m_head_cache > m_mask )
+            {
+                m_head_cache = m_head.load( std::memory_order_acquire );
+                if ( tail - m_head_cache > m_mask )
+                    return false;
+            }
+            new ( m_items + ( tail & m_mask ) ) _Type( std::forward<_Args>( args )... );
+            m_tail.store( tail + 1, std::memory_order_release );
+            return true;
+        }
+        bool try_push( const _Type& item )
+        {
+            return try_emplace( item );
+        }
+        bool try_push( _Type&& item )
+        {
+            return try_emplace( std::move( item ) );
+        }
+
+        // pushes up to count items, returns the number pushed
+        size_type push_batch( const _Type* items, size_type count )
+        {
+            size_type tail = m_tail.load( std::memory_order_relaxed );
+            size_type free = capacity( ) - ( tail - m_head_cache );
+            if ( free < count )
+            {
+                m_head_cache = m_head.load( std::memory_order_acquire );
+                free         = capacity( ) - ( tail - m_head_cache );
+            }
+            if ( count > free )
+                count = free;
+            for ( size_type i = 0; i < count; i++ )
+            {
+                new ( m_items + ( ( tail + i ) & m_mask ) ) _Type( items[i] );
+            }
+            m_tail.store( tail + count, std::memory_order_release );
+            return count;
+        }
+
+        // consumer side
+
+        bool try_pop( _Type& item )
+        {
+            size_type head = m_head.load( std::memory_order_relaxed );
+            if ( head == m_tail_cache )
+            {
+                m_tail_cache = m_tail.load( std::memory_order_acquire );
+                if ( head == m_tail_cache )
+                    return false;
+            }
+            _Type* slot = m_items + ( head & m_mask );
+            item        = std::move( *slot );
+            slot->~_Type( );
+            m_head.store( head + 1, std::memory_order_release );
+            return true;
+        }
+
+        // pops up to count items, returns the number popped
+        size_type pop_batch( _Type* items, size_type count )
+        {
+            size_type head      = m_head.load( std::memory_order_relaxed );
+            size_type available = m_tail_cache - head;
+            if ( available < count )
+            {
+                m_tail_cache = m_tail.load( std::memory_order_acquire );
+                available    = m_tail_cache - head;
+            }
+            if ( count > available )
+                count = available;
+            for ( size_type i = 0; i < count; i++ )
+            {
+                _Type* slot = m_items + ( ( head + i ) & m_mask );
+                items[i]    = std::move( *slot );
+                slot->~_Type( );
+            }
+            m_head.store( head + count, std::memory_order_release );
+            return count;
+        }
+
+    private:
+        // consumer line
+        alignas( CacheSize ) std::atomic<size_type> m_head;
+        size_type m_tail_cache;
+        struct_padding<CacheSize - sizeof( std::atomic<size_type> ) - sizeof( size_type )> m_padding1;
+        // producer line
+        std::atomic<size_type> m_tail;
+        size_type m_head_cache;
+        struct_padding<CacheSize - sizeof( std::atomic<size_type> ) - sizeof( size_type )> m_padding2;
+        // read-only after construction
+        _Type* m_items;
+        size_type m_mask;
+    };
+
+    // Bounded lock-free queue for any number of producers and consumers (Vyukov's algorithm:
+    // every cell carries a sequence number telling whose turn it is).
+    // Batch operations claim a whole range of cells with one CAS and then wait for cells
+    // that another thread is still in the middle of filling or emptying.
+    template <typename _Type, typename _Allocator = aligned_allocator<CacheSize>>
+    struct mpmc_queue
+    {
+    public:
+        typedef _Type value_type;
+        typedef size_t size_type;
+
+    private:
+        struct cell
+        {
+            std::atomic<size_type> sequence;
+            typename std::aligned_storage<sizeof( _Type ), alignof( _Type )>::type storage;
+
+            _Type* item( )
+            {
+                return reinterpret_cast<_Type*>( &storage );
+            }
+        };
+
+    public:
+        // capacity is rounded up to a power of two (at least 2)
+        explicit mpmc_queue( size_type capacity )
+            : m_head( 0 ), m_tail( 0 ), m_mask( round_up_pow2( capacity < 2 ? 2 : capacity ) - 1 )
+        {
+            size_type size = ( m_mask + 1 ) * sizeof( cell );
+            m_cells        = ( cell* )_Allocator::allocate( size );
+            if ( !m_cells )
+                throw std::bad_alloc( );
+            for ( size_type i = 0; i <= m_mask; i++ )
+            {
+                new ( &m_cells[i].sequence ) std::atomic<size_type>( i );
+            }
+        }
+        mpmc_queue( const mpmc_queue& ) = delete;
+        mpmc_queue& operator=( const mpmc_queue& ) = delete;
+        ~mpmc_queue( )
+        {
+            size_type tail = m_tail.load( std::memory_order_acquire );
+            for ( size_type head = m_head.load( std::memory_order_relaxed ); head != tail; head++ )
+            {
+                m_cells[head & m_mask].item( )->~_Type( );
+            }
+            _Allocator::deallocate( m_cells );
+        }
+
+        size_type capacity( ) const
+        {
+            return m_mask + 1;
+        }
+
+        // approximate when called concurrently
+        size_type size( ) const
+        {
+            size_type tail = m_tail.load( std::memory_order_acquire );
+            size_type head = m_head.load( std::memory_order_acquire );
+            return tail > head ? tail - head : 0;
+        }
+        bool empty( ) const
+        {
+            return size( ) == 0;
+        }
+
+        template <typename... _Args>
+        bool try_emplace( _Args&&... args )
+        {
+            size_type tail = m_tail.load( std::memory_order_relaxed );
+            for ( ;; )
+            {
+                cell& c        = m_cells[tail & m_mask];
+                size_type seq  = c.sequence.load( std::memory_order_acquire );
+                ptrdiff_t diff = ptrdiff_t( seq ) - ptrdiff_t( tail );
+                if ( diff == 0 )
+                {
+                    if ( m_tail.compare_exchange_weak( tail, tail + 1, std::memory_order_relaxed ) )
+                    {
+                        new ( c.item( ) ) _Type( std::forward<_Args>( args )... );
+                        c.sequence.store( tail + 1, std::memory_order_release );
+                        return true;
+                    }
+                }
+                else if ( diff < 0 )
+                {
+                    return false; // full
+                }
+                else
+                {
+                    tail = m_tail.load( std::memory_order_relaxed );
+                }
+            }
+        }
+        bool try_push( const _Type& item )
+        {
+            return try_emplace( item );
+        }
+        bool try_push( _Type&& item )
+        {
+            return try_emplace( std::move( item ) );
+        }
+
+        bool try_pop( _Type& item )
+        {
+            size_type head = m_head.load( std::memory_order_relaxed );
+            for ( ;; )
+            {
+                cell& c        = m_cells[head & m_mask];
+                size_type seq  = c.sequence.load( std::memory_order_acquire );
+                ptrdiff_t diff = ptrdiff_t( seq ) - ptrdiff_t( head + 1 );
+                if ( diff == 0 )
+                {
+                    if ( m_head.compare_exchange_weak( head, head + 1, std::memory_order_relaxed ) )
+                    {
+                        item = std::move( *c.item( ) );
+                        c.item( )->~_Type( );
+                        c.sequence.store( head + m_mask + 1, std::memory_order_release );
+                        return true;
+                    }
+                }
+                else if ( diff < 0 )
+                {
+                    return false; // empty
+                }
+                else
+                {
+                    head = m_head.load( std::memory_order_relaxed );
+                }
+            }
+        }
+
+        // pushes up to count items, returns the number pushed
+        size_type push_batch( const _Type* items, size_type count )
+        {
+            size_type tail, n;
+            do
+            {
+                // head first: the tail read after it can not be behind it, so used does not wrap
+                size_type head = m_head.load( std::memory_order_acquire );
+                tail           = m_tail.load( std::memory_order_relaxed );
+                size_type used = tail - head;
+                size_type free = used > m_mask ? 0 : capacity( ) - used;
+                n              = count < free ? count : free;
+                if ( n == 0 )
+                    return 0;
+            } while ( !m_tail.compare_exchange_weak( tail, tail + n, std::memory_order_relaxed ) );
+            for ( size_type i = 0; i < n; i++ )
+            {
+                cell& c = m_cells[( tail + i ) & m_mask];
+                // the consumer of the previous lap may still be moving the old item out
+                for ( unsigned spins = 0; c.sequence.load( std::memory_order_acquire ) != tail + i; )
+                {
+                    spin_wait( spins );
+                }
+                new ( c.item( ) ) _Type( items[i] );
+                c.sequence.store( tail + i + 1, std::memory_order_release );
+            }
+            return n;
+        }
+
+        // pops up to count items, returns the number popped
+        size_type pop_batch( _Type* items, size_type count )
+        {
+            size_type head = m_head.load( std::memory_order_relaxed );
+            size_type n;
+            do
+            {
+                size_type tail      = m_tail.load( std::memory_order_acquire );
+                size_type available = tail > head ? tail - head : 0;
+                n                   = count < available ? count : available;
+                if ( n == 0 )
+                    return 0;
+            } while ( !m_head.compare_exchange_weak( head, head + n, std::memory_order_relaxed ) );
+            for ( size_type i = 0; i < n; i++ )
+            {
+                cell& c = m_cells[( head + i ) & m_mask];
+                // the producer may still be constructing the item
+                for ( unsigned spins = 0; c.sequence.load( std::memory_order_acquire ) != head + i + 1; )
+                {
+                    spin_wait( spins );
+                }
+                items[i] = std::move( *c.item( ) );
+                c.item( )->~_Type( );
+                c.sequence.store( head + i + m_mask + 1, std::memory_order_release );
+            }
+            return n;
+        }
+
+    private:
+        alignas( CacheSize ) std::atomic<size_type> m_head;
+        struct_padding<CacheSize - sizeof( std::atomic<size_type> )> m_padding1;
+        std::atomic<size_type> m_tail;
+        struct_padding<CacheSize - sizeof( std::atomic<size_type> )> m_padding2;
+        cell* m_cells;
+        size_type m_mask;
+    };
+} // namespace dmk
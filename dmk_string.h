@@ -3,9 +3,20 @@
 #include "dmk.h"
 #include "dmk_assert.h"
 #include "dmk_memory.h"
+#include "dmk_hash.h"
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <iostream>
+#include <cstring>
+#include <emmintrin.h>
+#if defined( DMK_ARCH_AVX )
+#include <immintrin.h>
+#endif
 
 #include <cppformat/format.h>
 #include <cppformat/format.cc>
@@ -18,74 +29,581 @@ namespace dmk
 {
 #define REPL_CHAR ( 0xFFFD ) //
 
+    // Flips the case of the ASCII letters among 16 bytes ('a'..'z' with _Upper, 'A'..'Z' otherwise).
+    // Adding 128 - first moves the letters to -128..-103, the only signed values below -102, and
+    // keeps bytes >= 0x80 out of that range, so UTF-8 passes through unchanged
+    template <bool _Upper>
+    inline __m128i _ascii_case16( __m128i x )
+    {
+        __m128i shifted = _mm_add_epi8( x, _mm_set1_epi8( _Upper ? 128 - 'a' : 128 - 'A' ) );
+        __m128i alpha   = _mm_cmplt_epi8( shifted, _mm_set1_epi8( -128 + 26 ) );
+        return _mm_xor_si128( x, _mm_and_si128( alpha, _mm_set1_epi8( 0x20 ) ) );
+    }
+
+#if defined( DMK_ARCH_AVX2 )
+    template <bool _Upper>
+    inline __m256i _ascii_case32( __m256i x )
+    {
+        __m256i shifted = _mm256_add_epi8( x, _mm256_set1_epi8( _Upper ? 128 - 'a' : 128 - 'A' ) );
+        __m256i alpha   = _mm256_cmpgt_epi8( _mm256_set1_epi8( -128 + 26 ), shifted );
+        return _mm256_xor_si256( x, _mm256_and_si256( alpha, _mm256_set1_epi8( 0x20 ) ) );
+    }
+#endif
+
+    // ASCII case conversion of [input, input + size) into output (may be the same buffer)
+    template <bool _Upper>
+    inline void _ascii_case( const char* input, size_t size, char* output )
+    {
+        size_t i = 0;
+#if defined( DMK_ARCH_AVX2 )
+        for ( ; i + 32 <= size; i += 32 )
+        {
+            __m256i x = _mm256_loadu_si256( ( const __m256i* )( input + i ) );
+            _mm256_storeu_si256( ( __m256i* )( output + i ), _ascii_case32<_Upper>( x ) );
+        }
+#endif
+        for ( ; i + 16 <= size; i += 16 )
+        {
+            __m128i x = _mm_loadu_si128( ( const __m128i* )( input + i ) );
+            _mm_storeu_si128( ( __m128i* )( output + i ), _ascii_case16<_Upper>( x ) );
+        }
+        for ( ; i < size; i++ )
+        {
+            char c    = input[i];
+            output[i] = ( _Upper ? c >= 'a' && c <= 'z' : c >= 'A' && c <= 'Z' ) ? char( c ^ 0x20 ) : c;
+        }
+    }
+
+    inline char asci_lowercase( char c )
+    {
+        return c >= 'A' && c <= 'Z' ? char( c | 0x20 ) : c;
+    }
+
+    inline char asci_uppercase( char c )
+    {
+        return c >= 'a' && c <= 'z' ? char( c & ~0x20 ) : c;
+    }
+
+    // in place
+    inline void asci_lowercase( char* str, size_t size )
+    {
+        _ascii_case<false>( str, size, str );
+    }
+
+    inline void asci_uppercase( char* str, size_t size )
+    {
+        _ascii_case<true>( str, size, str );
+    }
+
+    // into a buffer of at least size bytes
+    inline void asci_lowercase( const char* input, size_t size, char* output )
+    {
+        _ascii_case<false>( input, size, output );
+    }
+
+    inline void asci_uppercase( const char* input, size_t size, char* output )
+    {
+        _ascii_case<true>( input, size, output );
+    }
+
     inline std::string asci_lowercase( const std::string& str )
     {
-        std::string temp = str;
-        std::transform( str.begin( ), str.end( ), temp.begin( ), ::tolower );
+        std::string temp( str.size( ), '\0' );
+        _ascii_case<false>( str.data( ), str.size( ), &temp[0] );
         return temp;
     }
 
     inline std::string asci_uppercase( const std::string& str )
     {
-        std::string temp = str;
-        std::transform( str.begin( ), str.end( ), temp.begin( ), ::toupper );
+        std::string temp( str.size( ), '\0' );
+        _ascii_case<true>( str.data( ), str.size( ), &temp[0] );
         return temp;
     }
 
-    inline bool matches( const std::string& pattern, const std::string& text )
+    template <typename _T>
+    inline std::string stringify( const _T& value )
     {
-        if ( pattern == "*" )
-            return true;
-        if ( pattern == text )
+        std::stringstream mem;
+        mem << value;
+        return mem.str( );
+    }
+
+    namespace utf8
+    {
+        inline bool is_continuation( char c )
+        {
+            return ( uint8_t( c ) & 0xC0 ) == 0x80;
+        }
+
+        // Code points that start at [p, p + block_size) as a bit mask: bit i is set when p[i] is not
+        // a continuation byte or follows an ASCII byte (before is the byte ahead of p, 0 at the start
+        // of the range). Continuation bytes 0x80..0xBF are the signed bytes below -64
+#if defined( DMK_ARCH_AVX2 )
+        enum
+        {
+            block_size = 32
+        };
+        inline uint64_t _starts( const char* p, char before )
+        {
+            __m256i v      = _mm256_loadu_si256( ( const __m256i* )p );
+            __m256i leads  = _mm256_cmpgt_epi8( v, _mm256_set1_epi8( -65 ) );
+            uint64_t lead  = uint32_t( _mm256_movemask_epi8( leads ) );
+            uint64_t ascii = ~uint32_t( _mm256_movemask_epi8( v ) );
+            return lead | ( ( ascii << 1 | ( uint8_t( before ) < 0x80 ) ) & 0xFFFFFFFF );
+        }
+        inline bool _ascii( const char* p )
+        {
+            return _mm256_movemask_epi8( _mm256_loadu_si256( ( const __m256i* )p ) ) == 0;
+        }
+#else
+        enum
+        {
+            block_size = 16
+        };
+        inline uint64_t _starts( const char* p, char before )
+        {
+            __m128i v      = _mm_loadu_si128( ( const __m128i* )p );
+            uint64_t lead  = uint32_t( _mm_movemask_epi8( _mm_cmpgt_epi8( v, _mm_set1_epi8( -65 ) ) ) );
+            uint64_t ascii = ~uint32_t( _mm_movemask_epi8( v ) );
+            return lead | ( ( ascii << 1 | ( uint8_t( before ) < 0x80 ) ) & 0xFFFF );
+        }
+        inline bool _ascii( const char* p )
+        {
+            return _mm_movemask_epi8( _mm_loadu_si128( ( const __m128i* )p ) ) == 0;
+        }
+#endif
+
+        inline bool _ascii16( const char* p )
+        {
+            return _mm_movemask_epi8( _mm_loadu_si128( ( const __m128i* )p ) ) == 0;
+        }
+
+        // Bytes taken by the code point starting with this lead byte (1 for invalid lead bytes)
+        inline int charlen_unsafe( const char* begin )
+        {
+            uint8_t c = uint8_t( *begin );
+            if ( c < 0xC0 )
+                return 1;
+            if ( c < 0xE0 )
+                return 2;
+            if ( c < 0xF0 )
+                return 3;
+            if ( c < 0xF8 )
+                return 4;
+            return 1;
+        }
+
+        // Whether p starts a code point of a range that begins at begin: every byte that is not a
+        // continuation byte does, and so does a run of stray continuation bytes at begin or after an
+        // ASCII byte
+        inline bool is_start( const char* begin, const char* p )
+        {
+            return !is_continuation( *p ) || p == begin || uint8_t( p[-1] ) < 0x80;
+        }
+
+        // decode, next, length and advance always agree on where code points are (see is_start).
+        // A malformed sequence, including a run of stray continuation bytes, decodes as one REPL_CHAR
+        inline const char* decode( const char* begin, const char* end, char32_t& output )
+        {
+            uint8_t c = uint8_t( *begin++ );
+            if ( c < 0x80 )
+            {
+                output = c;
+                return begin;
+            }
+            int len        = charlen_unsafe( begin - 1 );
+            char32_t ch    = len == 2 ? c & 0x1F : len == 3 ? c & 0x0F : c & 0x07;
+            int continued  = 0;
+            for ( ; begin < end && is_continuation( *begin ); begin++, continued++ )
+            {
+                ch = ( ch << 6 ) | ( uint8_t( *begin ) & 0x3F );
+            }
+            static const char32_t min_value[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+            if ( len == 1 || continued != len - 1 || ch < min_value[len] || ch > 0x10FFFF ||
+                 ( ch >= 0xD800 && ch <= 0xDFFF ) )
+            {
+                output = REPL_CHAR;
+            }
+            else
+            {
+                output = ch;
+            }
+            return begin;
+        }
+
+        inline const char* next( const char* begin, const char* end )
+        {
+            if ( begin >= end )
+                return end;
+            if ( uint8_t( *begin++ ) < 0x80 )
+                return begin;
+            while ( begin < end && is_continuation( *begin ) )
+            {
+                ++begin;
+            }
+            return begin;
+        }
+
+        // Number of code points in [begin, end)
+        inline size_t length( const char* begin, const char* end )
+        {
+            const char* start = begin;
+            size_t count      = 0;
+            for ( ; end - begin >= block_size; begin += block_size )
+            {
+                count += _ascii( begin ) ? size_t( block_size )
+                                         : bit_count( _starts( begin, begin == start ? 0 : begin[-1] ) );
+            }
+            for ( ; begin < end; begin++ )
+            {
+                count += is_start( start, begin );
+            }
+            return count;
+        }
+
+        // Number of code points in a null-terminated string
+        inline size_t length_unsafe( const char* begin )
+        {
+            return length( begin, begin + std::strlen( begin ) );
+        }
+
+        // True if [begin, end) has no byte >= 0x80
+        inline bool is_ascii( const char* begin, const char* end )
+        {
+            for ( ; end - begin >= block_size; begin += block_size )
+            {
+                if ( !_ascii( begin ) )
+                    return false;
+            }
+            for ( ; begin < end; begin++ )
+            {
+                if ( uint8_t( *begin ) >= 0x80 )
+                    return false;
+            }
             return true;
-        if ( pattern.empty( ) )
-            return false;
-        if ( pattern[0] == '!' )
+        }
+
+        // Skips pos code points, stops at end
+        inline const char* advance( const char* begin, const char* end, size_t pos )
+        {
+            if ( pos == 0 || begin >= end )
+                return begin;
+            // begin always starts a code point, look for the pos-th start after it
+            const char* p = begin + 1;
+            for ( ; end - p >= block_size; p += block_size )
+            {
+                if ( pos > size_t( block_size ) && _ascii( p ) )
+                {
+                    pos -= block_size;
+                    continue;
+                }
+                uint64_t starts = _starts( p, p[-1] );
+                size_t count    = bit_count( starts );
+                if ( count >= pos )
+                {
+                    for ( ; pos > 1; pos-- )
+                    {
+                        starts &= starts - 1;
+                    }
+                    return p + bit_scan_forward( starts );
+                }
+                pos -= count;
+            }
+            for ( ; p < end; p++ )
+            {
+                if ( is_start( begin, p ) && --pos == 0 )
+                    return p;
+            }
+            return end;
+        }
+
+        // Writes 1 to 4 bytes, invalid code points are written as REPL_CHAR
+        inline char* encode( char* output, char32_t input )
+        {
+            if ( input > 0x10FFFF || ( input >= 0xD800 && input <= 0xDFFF ) )
+                input = REPL_CHAR;
+            if ( input < 0x80 )
+            {
+                *output++ = char( input );
+            }
+            else if ( input < 0x800 )
+            {
+                *output++ = char( 0xC0 | ( input >> 6 ) );
+                *output++ = char( 0x80 | ( input & 0x3F ) );
+            }
+            else if ( input < 0x10000 )
+            {
+                *output++ = char( 0xE0 | ( input >> 12 ) );
+                *output++ = char( 0x80 | ( ( input >> 6 ) & 0x3F ) );
+                *output++ = char( 0x80 | ( input & 0x3F ) );
+            }
+            else
+            {
+                *output++ = char( 0xF0 | ( input >> 18 ) );
+                *output++ = char( 0x80 | ( ( input >> 12 ) & 0x3F ) );
+                *output++ = char( 0x80 | ( ( input >> 6 ) & 0x3F ) );
+                *output++ = char( 0x80 | ( input & 0x3F ) );
+            }
+            return output;
+        }
+
+        // Pointer to the first byte that is not part of well-formed UTF-8 (end if all valid):
+        // no overlong forms, surrogates, code points above U+10FFFF or truncated sequences
+        inline const char* validate_prefix( const char* begin, const char* end )
+        {
+            while ( begin < end )
+            {
+                if ( end - begin >= block_size && _ascii( begin ) )
+                {
+                    begin += block_size;
+                    continue;
+                }
+                uint8_t c = uint8_t( *begin );
+                if ( c < 0x80 )
+                {
+                    begin++;
+                    continue;
+                }
+                ptrdiff_t len = c < 0xC2 ? 0 : c <= 0xDF ? 2 : c <= 0xEF ? 3 : c <= 0xF4 ? 4 : 0;
+                if ( len == 0 || end - begin < len )
+                    return begin;
+                uint8_t c1 = uint8_t( begin[1] );
+                // the second byte range excludes overlong forms, surrogates and values above U+10FFFF
+                uint8_t lo = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+                uint8_t hi = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+                if ( c1 < lo || c1 > hi )
+                    return begin;
+                for ( ptrdiff_t i = 2; i < len; i++ )
+                {
+                    if ( !is_continuation( begin[i] ) )
+                        return begin;
+                }
+                begin += len;
+            }
+            return end;
+        }
+
+        inline bool validate( const char* begin, const char* end )
+        {
+            return validate_prefix( begin, end ) == end;
+        }
+
+        inline bool validate( const std::string& str )
+        {
+            return validate( str.data( ), str.data( ) + str.size( ) );
+        }
+        // std::string  uchar( char32_t ch );
+    }
+
+    inline std::string c32_u8( size_t count, char32_t ch )
+    {
+        char buffer[4];
+        size_t len = utf8::encode( buffer, ch ) - buffer;
+        std::string result;
+        result.reserve( count * len );
+        for ( size_t i = 0; i < count; i++ )
+        {
+            result.append( buffer, len );
+        }
+        return result;
+    }
+
+    // Transcoding. The buffer overloads return the number of units the whole conversion needs and
+    // write the output only when it fits in capacity (the buffer contents are unspecified otherwise).
+    // Pass output = nullptr, capacity = 0 to just measure. Malformed input becomes REPL_CHAR
+
+    // Widens 16 ASCII bytes to char16_t/char32_t
+    template <typename _Char>
+    inline void _widen_ascii( const char* input, _Char* output )
+    {
+        __m128i v    = _mm_loadu_si128( ( const __m128i* )input );
+        __m128i zero = _mm_setzero_si128( );
+        __m128i lo   = _mm_unpacklo_epi8( v, zero );
+        __m128i hi   = _mm_unpackhi_epi8( v, zero );
+        if ( sizeof( _Char ) == 2 )
         {
-            return matches( pattern.substr( 1 ), text );
+            _mm_storeu_si128( ( __m128i* )output, lo );
+            _mm_storeu_si128( ( __m128i* )( output + 8 ), hi );
         }
-        size_t len = pattern.size( ) - 1;
-        if ( text.front( ) == '*' )
+        else
         {
-            return pattern.substr( 1 ) == text.substr( text.size( ) - len, len );
+            _mm_storeu_si128( ( __m128i* )output, _mm_unpacklo_epi16( lo, zero ) );
+            _mm_storeu_si128( ( __m128i* )( output + 4 ), _mm_unpackhi_epi16( lo, zero ) );
+            _mm_storeu_si128( ( __m128i* )( output + 8 ), _mm_unpacklo_epi16( hi, zero ) );
+            _mm_storeu_si128( ( __m128i* )( output + 12 ), _mm_unpackhi_epi16( hi, zero ) );
         }
-        else if ( text.back( ) == '*' )
+    }
+
+    // Narrows 8 char16_t/char32_t to bytes if all of them are ASCII
+    template <typename _Char>
+    inline bool _narrow_ascii( const _Char* input, char* output )
+    {
+        __m128i v;
+        if ( sizeof( _Char ) == 2 )
         {
-            return pattern.substr( 0, len ) == text.substr( 0, len );
+            v = _mm_loadu_si128( ( const __m128i* )input );
         }
         else
         {
+            __m128i a = _mm_loadu_si128( ( const __m128i* )input );
+            __m128i b = _mm_loadu_si128( ( const __m128i* )( input + 4 ) );
+            // values above 0x7FFF saturate to 0x7FFF or 0x8000, either way they fail the check below
+            v = _mm_packs_epi32( a, b );
+        }
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_and_si128( v, _mm_set1_epi16( -128 ) ),
+                                                 _mm_setzero_si128( ) ) ) != 0xFFFF )
             return false;
+        _mm_storel_epi64( ( __m128i* )output, _mm_packus_epi16( v, v ) );
+        return true;
+    }
+
+    template <typename _Char>
+    inline size_t _u8_to( const char* begin, const char* end, _Char* output, size_t capacity )
+    {
+        size_t count = 0;
+        while ( begin < end )
+        {
+            if ( end - begin >= 16 && utf8::_ascii16( begin ) )
+            {
+                if ( count <= capacity && capacity - count >= 16 )
+                    _widen_ascii( begin, output + count );
+                count += 16;
+                begin += 16;
+                continue;
+            }
+            char32_t ch;
+            begin = utf8::decode( begin, end, ch );
+            if ( sizeof( _Char ) == 2 && ch >= 0x10000 )
+            {
+                if ( count + 2 <= capacity )
+                {
+                    output[count]     = _Char( 0xD800 + ( ( ch - 0x10000 ) >> 10 ) );
+                    output[count + 1] = _Char( 0xDC00 + ( ( ch - 0x10000 ) & 0x3FF ) );
+                }
+                count += 2;
+                continue;
+            }
+            if ( count < capacity )
+                output[count] = _Char( ch );
+            count++;
         }
+        return count;
     }
 
-    template <typename _T>
-    inline std::string stringify( const _T& value )
+    template <typename _Char>
+    inline size_t _to_u8( const _Char* begin, const _Char* end, char* output, size_t capacity )
     {
-        std::stringstream mem;
-        mem << value;
-        return mem.str( );
+        size_t count = 0;
+        char buffer[4];
+        while ( begin < end )
+        {
+            if ( end - begin >= 8 && count + 8 <= capacity && _narrow_ascii( begin, output + count ) )
+            {
+                count += 8;
+                begin += 8;
+                continue;
+            }
+            char32_t ch = char32_t( *begin++ );
+            if ( sizeof( _Char ) == 2 && ch >= 0xD800 && ch <= 0xDFFF )
+            {
+                char32_t low = begin < end ? char32_t( *begin ) : 0;
+                if ( ch <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF )
+                {
+                    ch = 0x10000 + ( ( ch - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+                    begin++;
+                }
+                else
+                    ch = REPL_CHAR; // lone surrogate
+            }
+            if ( ch < 0x80 )
+            {
+                if ( count < capacity )
+                    output[count] = char( ch );
+                count++;
+                continue;
+            }
+            size_t len = utf8::encode( buffer, ch ) - buffer;
+            if ( count + len <= capacity )
+                std::memcpy( output + count, buffer, len );
+            count += len;
+        }
+        return count;
     }
 
-    namespace utf8
+    inline size_t u8_u16( const char* begin, const char* end, char16_t* output, size_t capacity )
     {
-        const char* decode( const char* begin, const char* end, char32_t& output );
-        int charlen_unsafe( const char* begin );
-        const char* next( const char* begin, const char* end );
-        size_t length( const char* begin, const char* end );
-        size_t length_unsafe( const char* begin );
-        const char* advance( const char* begin, const char* end, size_t pos );
-        char* encode( char* output, char32_t input );
-        // std::string  uchar( char32_t ch );
+        return _u8_to( begin, end, output, capacity );
+    }
+    inline size_t u8_u32( const char* begin, const char* end, char32_t* output, size_t capacity )
+    {
+        return _u8_to( begin, end, output, capacity );
+    }
+    inline size_t u8_w( const char* begin, const char* end, wchar_t* output, size_t capacity )
+    {
+        return _u8_to( begin, end, output, capacity );
+    }
+    inline size_t u16_u8( const char16_t* begin, const char16_t* end, char* output, size_t capacity )
+    {
+        return _to_u8( begin, end, output, capacity );
+    }
+    inline size_t u32_u8( const char32_t* begin, const char32_t* end, char* output, size_t capacity )
+    {
+        return _to_u8( begin, end, output, capacity );
+    }
+    inline size_t w_u8( const wchar_t* begin, const wchar_t* end, char* output, size_t capacity )
+    {
+        return _to_u8( begin, end, output, capacity );
+    }
+
+    // One pass into a buffer of the largest possible size (every byte/unit can produce at most
+    // one UTF-16/UTF-32 unit, every UTF-16/UTF-32 unit at most 3/4 bytes)
+    template <typename _String>
+    inline _String _u8_to_string( const std::string& s )
+    {
+        _String result( s.size( ), 0 );
+        result.resize( _u8_to( s.data( ), s.data( ) + s.size( ), &result[0], result.size( ) ) );
+        return result;
+    }
+
+    template <typename _Char>
+    inline std::string _to_u8_string( const std::basic_string<_Char>& s )
+    {
+        std::string result( s.size( ) * ( sizeof( _Char ) == 2 ? 3 : 4 ), 0 );
+        result.resize( _to_u8( s.data( ), s.data( ) + s.size( ), &result[0], result.size( ) ) );
+        return result;
     }
 
-    std::wstring u8_w( const std::string& s );
-    std::u16string u8_u16( const std::string& s );
-    std::u32string u8_u32( const std::string& s );
-    std::string c32_u8( size_t count, char32_t ch );
-    std::string w_u8( const std::wstring& s );
-    std::string u16_u8( const std::u16string& s );
-    std::string u32_u8( const std::u32string& s );
+    inline std::wstring u8_w( const std::string& s )
+    {
+        return _u8_to_string<std::wstring>( s );
+    }
+    inline std::u16string u8_u16( const std::string& s )
+    {
+        return _u8_to_string<std::u16string>( s );
+    }
+    inline std::u32string u8_u32( const std::string& s )
+    {
+        return _u8_to_string<std::u32string>( s );
+    }
+    inline std::string w_u8( const std::wstring& s )
+    {
+        return _to_u8_string( s );
+    }
+    inline std::string u16_u8( const std::u16string& s )
+    {
+        return _to_u8_string( s );
+    }
+    inline std::string u32_u8( const std::u32string& s )
+    {
+        return _to_u8_string( s );
+    }
+
+    // declared here, defined in dmk_memory.h (which may include this header before its body)
+    struct malloc_allocator;
+    template <typename _Type, size_t N, typename _Allocator>
+    struct small_vector;
+
+    struct u8string_view;
 
     struct u8string
     {
@@ -209,10 +727,17 @@ namespace dmk
         u8string( const std::string& str ) : m_str( str )
         {
         }
-        u8string( const u8string& str ) : m_str( str.m_str )
+        u8string( const u8string& str )
+            : m_str( str.m_str ),
+              m_length( str.m_length.load( std::memory_order_relaxed ) ),
+              m_ascii( str.m_ascii.load( std::memory_order_relaxed ) )
         {
         }
-        u8string( u8string&& str ) noexcept : m_str( std::move( str.m_str ) )
+        u8string( u8string&& str ) noexcept
+            : m_str( std::move( str.m_str ) ),
+              m_length( str.m_length.exchange( unknown_length, std::memory_order_relaxed ) ),
+              m_ascii( str.m_ascii.exchange( unknown_ascii, std::memory_order_relaxed ) ),
+              m_index( str.m_index.exchange( nullptr, std::memory_order_relaxed ) )
         {
         }
         u8string( std::string&& str ) noexcept : m_str( std::move( str ) )
@@ -230,33 +755,59 @@ namespace dmk
         u8string( size_type count, char32_t ch ) : m_str( c32_u8( count, ch ) )
         {
         }
+        ~u8string( )
+        {
+            delete m_index.load( std::memory_order_relaxed );
+        }
         u8string& operator=( const u8string& str )
         {
-            m_str = str.m_str;
+            if ( this != &str )
+            {
+                m_str = str.m_str;
+                reset_cache( );
+                m_length.store( str.m_length.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+                m_ascii.store( str.m_ascii.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+            }
             return *this;
         }
         u8string& operator=( u8string&& str )
         {
-            m_str = std::move( str.m_str );
+            if ( this != &str )
+            {
+                m_str = std::move( str.m_str );
+                reset_cache( );
+                m_length.store( str.m_length.exchange( unknown_length, std::memory_order_relaxed ),
+                                std::memory_order_relaxed );
+                m_ascii.store( str.m_ascii.exchange( unknown_ascii, std::memory_order_relaxed ),
+                               std::memory_order_relaxed );
+                m_index.store( str.m_index.exchange( nullptr, std::memory_order_relaxed ),
+                               std::memory_order_relaxed );
+            }
             return *this;
         }
         u8string& operator=( const std::string& str )
         {
             m_str = str;
+            reset_cache( );
             return *this;
         }
         u8string& operator=( std::string&& str )
         {
             m_str = std::move( str );
+            reset_cache( );
             return *this;
         }
         u8string& operator=( const char* str )
         {
             m_str = std::string( str );
+            reset_cache( );
             return *this;
         }
+        // Changes through the returned reference are allowed until invalidate( ) is called; in the
+        // meantime nothing is cached (length( ), is_ascii( ) and iterator_at( ) rescan every time)
         std::string& str( )
         {
+            expose( );
             return m_str;
         }
         const std::string& str( ) const
@@ -287,19 +838,39 @@ namespace dmk
         {
             return m_str.c_str( );
         }
+        // same rules as the mutable str( )
         char* data( )
         {
+            expose( );
             return const_cast<char*>( m_str.data( ) );
         }
         size_type size( ) const
         {
             return m_str.size( );
         }
+        // code points, counted once and cached until the string changes
         size_type length( ) const
         {
-            const_pointer b = _begin( );
-            size_type s = size( );
-            return utf8::length( b, b + s );
+            size_type length = m_length.load( std::memory_order_relaxed );
+            if ( length == unknown_length )
+            {
+                length = utf8::length( _begin( ), _end( ) );
+                if ( !m_exposed )
+                    m_length.store( length, std::memory_order_relaxed );
+            }
+            return length;
+        }
+        // no byte >= 0x80, scanned once and cached like length( )
+        bool is_ascii( ) const
+        {
+            uint8_t ascii = m_ascii.load( std::memory_order_relaxed );
+            if ( ascii == unknown_ascii )
+            {
+                ascii = utf8::is_ascii( _begin( ), _end( ) ) ? 1 : 0;
+                if ( !m_exposed )
+                    m_ascii.store( ascii, std::memory_order_relaxed );
+            }
+            return ascii == 1;
         }
         const char* data( ) const
         {
@@ -352,19 +923,8 @@ namespace dmk
             }
             return iterator_from_byte_pos( pos );
         }
-        const_iterator find( char32_t ch, size_type offset = 0 ) const
-        {
-            return find( u8string( 1, ch ), offset );
-        }
-        const_iterator find( const u8string& str, size_type offset = 0 ) const
-        {
-            size_type pos = m_str.find( str.str( ), offset );
-            if ( pos == std::string::npos )
-            {
-                return end( );
-            }
-            return iterator_from_byte_pos( pos );
-        }
+        const_iterator find( char32_t ch, size_type offset = 0 ) const;
+        const_iterator find( u8string_view str, size_type offset = 0 ) const;
         bool empty( ) const
         {
             return m_str.empty( );
@@ -372,6 +932,13 @@ namespace dmk
         void clear( )
         {
             m_str.clear( );
+            reset_cache( );
+        }
+        // ends changes through the mutable str( )/data( ): drops what was cached and caches again
+        void invalidate( )
+        {
+            m_exposed = false;
+            reset_cache( );
         }
         const_iterator iterator_from_pointer( const_pointer ptr ) const
         {
@@ -384,18 +951,50 @@ namespace dmk
             DMK_ASSERT_LE( _begin( ) + pos, _end( ) );
             return const_iterator( _begin( ) + pos, _end( ) );
         }
-        char32_t operator[]( size_type index ) const
-        {
-            return *( begin( ) + index );
-        }
-        u8string& operator+=( const u8string& other )
+        // O(1) for ASCII strings, otherwise a lookup in the code point index plus a short scan
+        const_iterator iterator_at( size_type index ) const
         {
-            m_str += other.m_str;
-            return *this;
-        }
+            if ( is_ascii( ) )
+            {
+                return const_iterator( _begin( ) + ( index < size( ) ? index : size( ) ), _end( ) );
+            }
+            if ( m_exposed )
+            {
+                return const_iterator( utf8::advance( _begin( ), _end( ), index ), _end( ) );
+            }
+            const std::vector<size_type>& offsets = code_point_index( );
+            size_type block                       = index / IndexStep;
+            if ( block >= offsets.size( ) )
+            {
+                return end( );
+            }
+            return const_iterator( utf8::advance( _begin( ) + offsets[block], _end( ), index % IndexStep ),
+                                   _end( ) );
+        }
+        char32_t operator[]( size_type index ) const
+        {
+            return *iterator_at( index );
+        }
+        u8string& operator+=( const u8string& other )
+        {
+            size_type length       = m_length.load( std::memory_order_relaxed );
+            size_type other_length = other.m_length.load( std::memory_order_relaxed );
+            // the counts stay additive unless other starts with continuation bytes that join the
+            // non-ASCII sequence at the end of this string
+            bool additive = other.empty( ) || empty( ) || !utf8::is_continuation( other.m_str[0] ) ||
+                            uint8_t( m_str.back( ) ) < 0x80;
+            m_str += other.m_str;
+            reset_cache( );
+            if ( length != unknown_length && other_length != unknown_length && additive )
+            {
+                m_length.store( length + other_length, std::memory_order_relaxed );
+            }
+            return *this;
+        }
         u8string& operator+=( const char* other )
         {
             m_str += other;
+            reset_cache( );
             return *this;
         }
 
@@ -416,7 +1015,58 @@ namespace dmk
         {
             return m_str.data( ) + m_str.size( );
         }
+
+        enum : size_type
+        {
+            unknown_length = size_type( -1 ),
+            IndexStep      = 64 // code points between index entries
+        };
+        enum : uint8_t
+        {
+            unknown_ascii = 2
+        };
+
+        void reset_cache( )
+        {
+            m_length.store( unknown_length, std::memory_order_relaxed );
+            m_ascii.store( unknown_ascii, std::memory_order_relaxed );
+            delete m_index.exchange( nullptr, std::memory_order_relaxed );
+        }
+
+        // the caller may change the string behind our back from now on
+        void expose( )
+        {
+            reset_cache( );
+            m_exposed = true;
+        }
+
+        // byte offsets of code points 0, IndexStep, 2 * IndexStep, ... built on first use
+        const std::vector<size_type>& code_point_index( ) const
+        {
+            std::vector<size_type>* index = m_index.load( std::memory_order_acquire );
+            if ( index )
+            {
+                return *index;
+            }
+            std::unique_ptr<std::vector<size_type>> fresh( new std::vector<size_type>( ) );
+            fresh->reserve( length( ) / IndexStep + 1 );
+            for ( const_pointer p = _begin( ); p < _end( ); p = utf8::advance( p, _end( ), IndexStep ) )
+            {
+                fresh->push_back( size_type( p - _begin( ) ) );
+            }
+            // another thread may have built it in the meantime, keep the first one
+            if ( m_index.compare_exchange_strong( index, fresh.get( ), std::memory_order_acq_rel ) )
+            {
+                return *fresh.release( );
+            }
+            return *index;
+        }
+
         std::string m_str;
+        mutable std::atomic<size_type> m_length{ unknown_length };
+        mutable std::atomic<uint8_t> m_ascii{ unknown_ascii };
+        mutable std::atomic<std::vector<size_type>*> m_index{ nullptr };
+        bool m_exposed{ false }; // a mutable str( )/data( ) was handed out, see invalidate( )
     };
 
     inline bool operator==( const u8string& lh, const u8string& rh )
@@ -449,42 +1099,1331 @@ namespace dmk
         return lh.str( ) > rh.str( );
     }
 
-    inline u8string operator+( const u8string& lh, const u8string& rh )
-    {
-        return lh.str( ) + rh.str( );
-    }
+    inline u8string operator+( const u8string& lh, const u8string& rh )
+    {
+        return lh.str( ) + rh.str( );
+    }
+
+    inline u8string operator+( const char* lh, const u8string& rh )
+    {
+        return lh + rh.str( );
+    }
+
+    inline u8string operator+( const u8string& lh, const char* rh )
+    {
+        return lh.str( ) + rh;
+    }
+
+    // a temporary left-hand side is appended to in place, so a + "/" + b + "/" + c builds one
+    // string instead of one per step
+    inline u8string operator+( u8string&& lh, const u8string& rh )
+    {
+        lh += rh;
+        return std::move( lh );
+    }
+
+    inline u8string operator+( u8string&& lh, const char* rh )
+    {
+        lh += rh;
+        return std::move( lh );
+    }
+
+    inline std::ostream& operator<<( std::ostream& os, const u8string& str )
+    {
+        os << str.str( );
+        return os;
+    }
+
+    // Non-owning UTF-8 string: a pointer and a byte count into someone else's storage.
+    // Iterates like u8string, substr and find return views/iterators into the same storage
+    struct u8string_view
+    {
+    public:
+        typedef char value_type;
+        typedef const value_type* const_pointer;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        typedef u8string::const_iterator const_iterator;
+
+    public:
+        u8string_view( ) noexcept : m_data( nullptr ), m_size( 0 )
+        {
+        }
+        u8string_view( const char* str ) : m_data( str ), m_size( std::strlen( str ) )
+        {
+        }
+        u8string_view( const char* str, size_type size ) noexcept : m_data( str ), m_size( size )
+        {
+        }
+        u8string_view( const char* first, const char* last ) noexcept
+            : m_data( first ), m_size( last - first )
+        {
+        }
+        u8string_view( const std::string& str ) noexcept : m_data( str.data( ) ), m_size( str.size( ) )
+        {
+        }
+        u8string_view( const u8string& str ) noexcept : m_data( str.data( ) ), m_size( str.size( ) )
+        {
+        }
+        // copy into an owning string
+        std::string str( ) const
+        {
+            return std::string( m_data, m_size );
+        }
+        const char* data( ) const
+        {
+            return m_data;
+        }
+        size_type size( ) const
+        {
+            return m_size;
+        }
+        bool empty( ) const
+        {
+            return m_size == 0;
+        }
+        // code points (not cached, unlike u8string)
+        size_type length( ) const
+        {
+            return utf8::length( m_data, m_data + m_size );
+        }
+        char front( ) const
+        {
+            return m_data[0];
+        }
+        char back( ) const
+        {
+            return m_data[m_size - 1];
+        }
+        const_iterator cbegin( ) const
+        {
+            return const_iterator( m_data, m_data + m_size );
+        }
+        const_iterator cend( ) const
+        {
+            return const_iterator( m_data + m_size, m_data + m_size );
+        }
+        const_iterator begin( ) const
+        {
+            return cbegin( );
+        }
+        const_iterator end( ) const
+        {
+            return cend( );
+        }
+        u8string_view substr( const const_iterator& first, const const_iterator& last ) const
+        {
+            return u8string_view( first.ptr( ), last.ptr( ) );
+        }
+        u8string_view substr( const const_iterator& first, size_type count ) const
+        {
+            return substr( first, first + count );
+        }
+        u8string_view substr( const const_iterator& first ) const
+        {
+            return substr( first, end( ) );
+        }
+        // byte based, like std::string
+        u8string_view bytes( size_type pos, size_type count = size_type( -1 ) ) const
+        {
+            if ( pos > m_size )
+                pos = m_size;
+            return u8string_view( m_data + pos, count < m_size - pos ? count : m_size - pos );
+        }
+        bool starts_with( u8string_view prefix ) const
+        {
+            return prefix.m_size <= m_size && std::memcmp( m_data, prefix.m_data, prefix.m_size ) == 0;
+        }
+        bool ends_with( u8string_view suffix ) const
+        {
+            return suffix.m_size <= m_size &&
+                   std::memcmp( m_data + m_size - suffix.m_size, suffix.m_data, suffix.m_size ) == 0;
+        }
+        // byte position of str at or after offset, npos if not found
+        size_type find_bytes( u8string_view str, size_type offset = 0 ) const
+        {
+            if ( offset > m_size || str.m_size > m_size - offset )
+                return npos;
+            if ( str.empty( ) )
+                return offset;
+            const char* last = m_data + m_size - str.m_size;
+            for ( const char* p = m_data + offset; p <= last; p++ )
+            {
+                p = ( const char* )std::memchr( p, str.m_data[0], last - p + 1 );
+                if ( !p )
+                    break;
+                if ( std::memcmp( p, str.m_data, str.m_size ) == 0 )
+                    return p - m_data;
+            }
+            return npos;
+        }
+        const_iterator find( char ch, size_type offset = 0 ) const
+        {
+            if ( offset >= m_size )
+                return end( );
+            const char* p = ( const char* )std::memchr( m_data + offset, ch, m_size - offset );
+            return p ? iterator_from_pointer( p ) : end( );
+        }
+        const_iterator find( char32_t ch, size_type offset = 0 ) const
+        {
+            char buffer[4];
+            return find( u8string_view( buffer, utf8::encode( buffer, ch ) ), offset );
+        }
+        const_iterator find( u8string_view str, size_type offset = 0 ) const
+        {
+            size_type pos = find_bytes( str, offset );
+            return pos == npos ? end( ) : iterator_from_byte_pos( pos );
+        }
+        const_iterator iterator_from_pointer( const_pointer ptr ) const
+        {
+            DMK_ASSERT_GE( ptr, m_data );
+            DMK_ASSERT_LE( ptr, m_data + m_size );
+            return const_iterator( ptr, m_data + m_size );
+        }
+        const_iterator iterator_from_byte_pos( size_type pos ) const
+        {
+            DMK_ASSERT_LE( pos, m_size );
+            return const_iterator( m_data + pos, m_data + m_size );
+        }
+        // walks from the start, prefer iterators (or u8string, which keeps an index) in loops
+        char32_t operator[]( size_type index ) const
+        {
+            return *( begin( ) + index );
+        }
+
+        static const size_type npos = size_type( -1 );
+
+    private:
+        const char* m_data;
+        size_type m_size;
+    };
+
+    inline int compare( u8string_view lh, u8string_view rh )
+    {
+        size_t size = lh.size( ) < rh.size( ) ? lh.size( ) : rh.size( );
+        int result  = size ? std::memcmp( lh.data( ), rh.data( ), size ) : 0;
+        if ( result != 0 )
+            return result;
+        return lh.size( ) < rh.size( ) ? -1 : lh.size( ) > rh.size( ) ? 1 : 0;
+    }
+
+    inline bool operator==( u8string_view lh, u8string_view rh )
+    {
+        return lh.size( ) == rh.size( ) && compare( lh, rh ) == 0;
+    }
+
+    inline bool operator!=( u8string_view lh, u8string_view rh )
+    {
+        return !( lh == rh );
+    }
+
+    inline bool operator<=( u8string_view lh, u8string_view rh )
+    {
+        return compare( lh, rh ) <= 0;
+    }
+
+    inline bool operator>=( u8string_view lh, u8string_view rh )
+    {
+        return compare( lh, rh ) >= 0;
+    }
+
+    inline bool operator<( u8string_view lh, u8string_view rh )
+    {
+        return compare( lh, rh ) < 0;
+    }
+
+    inline bool operator>( u8string_view lh, u8string_view rh )
+    {
+        return compare( lh, rh ) > 0;
+    }
+
+    inline std::ostream& operator<<( std::ostream& os, u8string_view str )
+    {
+        os.write( str.data( ), str.size( ) );
+        return os;
+    }
+
+    inline u8string::const_iterator u8string::find( u8string_view str, size_type offset ) const
+    {
+        size_type pos = u8string_view( *this ).find_bytes( str, offset );
+        if ( pos == u8string_view::npos )
+        {
+            return end( );
+        }
+        return iterator_from_byte_pos( pos );
+    }
+
+    inline u8string::const_iterator u8string::find( char32_t ch, size_type offset ) const
+    {
+        char buffer[4];
+        return find( u8string_view( buffer, utf8::encode( buffer, ch ) ), offset );
+    }
+
+    // zero-copy u8string interface for a std::string
+    inline u8string_view u8( const std::string& str )
+    {
+        return u8string_view( str );
+    }
+
+    inline uint64_t hash( u8string_view str, uint64_t seed = 0 )
+    {
+        return hash( str.data( ), str.size( ), seed );
+    }
+
+    inline size_t _concat_size( )
+    {
+        return 0;
+    }
+    template <typename... _Pieces>
+    inline size_t _concat_size( u8string_view piece, const _Pieces&... pieces )
+    {
+        return piece.size( ) + _concat_size( pieces... );
+    }
+    template <typename... _Pieces>
+    inline size_t _concat_size( char, const _Pieces&... pieces )
+    {
+        return 1 + _concat_size( pieces... );
+    }
+
+    inline void _concat_append( std::string& )
+    {
+    }
+    template <typename... _Pieces>
+    inline void _concat_append( std::string& output, u8string_view piece, const _Pieces&... pieces )
+    {
+        output.append( piece.data( ), piece.size( ) );
+        _concat_append( output, pieces... );
+    }
+    template <typename... _Pieces>
+    inline void _concat_append( std::string& output, char piece, const _Pieces&... pieces )
+    {
+        output.push_back( piece );
+        _concat_append( output, pieces... );
+    }
+
+    // Joins strings, views, C strings and single chars with one allocation: the sizes are summed
+    // first, then every piece is copied once (a chain of operator+ allocates per step)
+    //     u8string path = concat( root, "/", dir, '/', name );
+    template <typename... _Pieces>
+    inline u8string concat( const _Pieces&... pieces )
+    {
+        std::string result;
+        result.reserve( _concat_size( pieces... ) );
+        _concat_append( result, pieces... );
+        return u8string( std::move( result ) );
+    }
+
+    // Growable null-terminated UTF-8 buffer for building strings piece by piece. The first
+    // InlineSize - 1 bytes live inside the object, beyond that memory comes from _Allocator
+    // (any allocator of dmk_memory.h), e.g. per-request keys without touching the heap:
+    //     arena_allocator::scope scope;
+    //     u8string_builder<arena_allocator> key;
+    //     key << tenant << '/' << user_id << '/' << name;
+    //     lookup( key.view( ) );
+    template <typename _Allocator = malloc_allocator, size_t InlineSize = 128>
+    struct u8string_builder
+    {
+    public:
+        typedef size_t size_type;
+
+        static_assert( InlineSize > 0, "u8string_builder needs inline room for the terminator" );
+
+    public:
+        u8string_builder( ) DMK_NOEXCEPT : m_data( m_inline ), m_size( 0 ), m_capacity( InlineSize - 1 )
+        {
+            m_inline[0] = 0;
+        }
+        explicit u8string_builder( size_type capacity ) : u8string_builder( )
+        {
+            reserve( capacity );
+        }
+        u8string_builder( const u8string_builder& ) = delete;
+        u8string_builder& operator=( const u8string_builder& ) = delete;
+        ~u8string_builder( )
+        {
+            if ( m_data != m_inline )
+                _Allocator::deallocate( m_data );
+        }
+
+        const char* data( ) const
+        {
+            return m_data;
+        }
+        const char* c_str( ) const
+        {
+            return m_data;
+        }
+        size_type size( ) const
+        {
+            return m_size;
+        }
+        bool empty( ) const
+        {
+            return m_size == 0;
+        }
+        // bytes that fit without reallocation
+        size_type capacity( ) const
+        {
+            return m_capacity;
+        }
+        // valid until the next change
+        u8string_view view( ) const
+        {
+            return u8string_view( m_data, m_size );
+        }
+        operator u8string_view( ) const
+        {
+            return view( );
+        }
+        std::string str( ) const
+        {
+            return std::string( m_data, m_size );
+        }
+
+        void reserve( size_type capacity )
+        {
+            if ( capacity > m_capacity )
+                reallocate( capacity );
+        }
+        void clear( )
+        {
+            m_size    = 0;
+            m_data[0] = 0;
+        }
+
+        u8string_builder& append( const char* data, size_type size )
+        {
+            if ( m_size + size > m_capacity )
+                reallocate( m_size + size > m_capacity * 2 ? m_size + size : m_capacity * 2 );
+            std::memcpy( m_data + m_size, data, size );
+            m_size += size;
+            m_data[m_size] = 0;
+            return *this;
+        }
+        u8string_builder& append( u8string_view str )
+        {
+            return append( str.data( ), str.size( ) );
+        }
+        u8string_builder& append( size_type count, char ch )
+        {
+            reserve( m_size + count );
+            std::memset( m_data + m_size, ch, count );
+            m_size += count;
+            m_data[m_size] = 0;
+            return *this;
+        }
+        u8string_builder& append( char32_t ch )
+        {
+            char buffer[4];
+            return append( buffer, size_type( utf8::encode( buffer, ch ) - buffer ) );
+        }
+        void push_back( char ch )
+        {
+            if ( m_size == m_capacity )
+                reallocate( m_capacity * 2 );
+            m_data[m_size++] = ch;
+            m_data[m_size]   = 0;
+        }
+
+        // decimal
+        template <typename _Int>
+        typename std::enable_if<std::is_integral<_Int>::value, u8string_builder&>::type
+        append_number( _Int value )
+        {
+            typedef typename std::make_unsigned<_Int>::type unsigned_type;
+            char buffer[24];
+            char* end          = buffer + sizeof( buffer );
+            char* begin        = end;
+            bool negative      = std::is_signed<_Int>::value && value < _Int( 0 );
+            unsigned_type rest = unsigned_type( value );
+            if ( negative )
+                rest = unsigned_type( 0 - rest );
+            do
+            {
+                *--begin = char( '0' + rest % 10 );
+                rest /= 10;
+            } while ( rest );
+            if ( negative )
+                *--begin = '-';
+            return append( begin, size_type( end - begin ) );
+        }
+
+        template <typename _Type>
+        u8string_builder& operator+=( const _Type& value )
+        {
+            return *this << value;
+        }
+
+        u8string_builder& operator<<( u8string_view str )
+        {
+            return append( str );
+        }
+        u8string_builder& operator<<( const char* str )
+        {
+            return append( u8string_view( str ) );
+        }
+        u8string_builder& operator<<( const std::string& str )
+        {
+            return append( str.data( ), str.size( ) );
+        }
+        u8string_builder& operator<<( const u8string& str )
+        {
+            return append( str.data( ), str.size( ) );
+        }
+        u8string_builder& operator<<( char ch )
+        {
+            push_back( ch );
+            return *this;
+        }
+        u8string_builder& operator<<( char32_t ch )
+        {
+            return append( ch );
+        }
+        template <typename _Int>
+        typename std::enable_if<std::is_integral<_Int>::value && !std::is_same<_Int, bool>::value &&
+                                    !std::is_same<_Int, char>::value && !std::is_same<_Int, char32_t>::value,
+                                u8string_builder&>::type
+        operator<<( _Int value )
+        {
+            return append_number( value );
+        }
+
+    private:
+        void reallocate( size_type capacity )
+        {
+            size_type bytes = capacity + 1;
+            char* fresh     = ( char* )_Allocator::allocate( bytes );
+            if ( !fresh )
+                throw std::bad_alloc( );
+            std::memcpy( fresh, m_data, m_size + 1 );
+            if ( m_data != m_inline )
+                _Allocator::deallocate( m_data );
+            m_data     = fresh;
+            m_capacity = bytes - 1;
+        }
+
+        char* m_data;
+        size_type m_size;
+        size_type m_capacity;
+        char m_inline[InlineSize];
+    };
+
+    // Unicode simple case folding (CaseFolding.txt, statuses C and S, Unicode 14.0): one code point
+    // always folds to one code point. A range folds first, first + stride, ... last by adding delta
+    struct _fold_range
+    {
+        char32_t first;
+        char32_t last;
+        int32_t delta;
+        uint32_t stride;
+    };
+
+    inline char32_t fold_case( char32_t ch )
+    {
+        if ( ch < 0x80 )
+            return ch >= 'A' && ch <= 'Z' ? ch | 0x20 : ch;
+        static constexpr _fold_range ranges[] = {
+                { 0x00B5, 0x00B5, 775, 1 }, { 0x00C0, 0x00D6, 32, 1 }, { 0x00D8, 0x00DE, 32, 1 },
+                { 0x0100, 0x012E, 1, 2 }, { 0x0132, 0x0136, 1, 2 }, { 0x0139, 0x0147, 1, 2 },
+                { 0x014A, 0x0176, 1, 2 }, { 0x0178, 0x0178, -121, 1 }, { 0x0179, 0x017D, 1, 2 },
+                { 0x017F, 0x017F, -268, 1 }, { 0x0181, 0x0181, 210, 1 }, { 0x0182, 0x0184, 1, 2 },
+                { 0x0186, 0x0186, 206, 1 }, { 0x0187, 0x0187, 1, 1 }, { 0x0189, 0x018A, 205, 1 },
+                { 0x018B, 0x018B, 1, 1 }, { 0x018E, 0x018E, 79, 1 }, { 0x018F, 0x018F, 202, 1 },
+                { 0x0190, 0x0190, 203, 1 }, { 0x0191, 0x0191, 1, 1 }, { 0x0193, 0x0193, 205, 1 },
+                { 0x0194, 0x0194, 207, 1 }, { 0x0196, 0x0196, 211, 1 }, { 0x0197, 0x0197, 209, 1 },
+                { 0x0198, 0x0198, 1, 1 }, { 0x019C, 0x019C, 211, 1 }, { 0x019D, 0x019D, 213, 1 },
+                { 0x019F, 0x019F, 214, 1 }, { 0x01A0, 0x01A4, 1, 2 }, { 0x01A6, 0x01A6, 218, 1 },
+                { 0x01A7, 0x01A7, 1, 1 }, { 0x01A9, 0x01A9, 218, 1 }, { 0x01AC, 0x01AC, 1, 1 },
+                { 0x01AE, 0x01AE, 218, 1 }, { 0x01AF, 0x01AF, 1, 1 }, { 0x01B1, 0x01B2, 217, 1 },
+                { 0x01B3, 0x01B5, 1, 2 }, { 0x01B7, 0x01B7, 219, 1 }, { 0x01B8, 0x01B8, 1, 1 },
+                { 0x01BC, 0x01BC, 1, 1 }, { 0x01C4, 0x01C4, 2, 1 }, { 0x01C5, 0x01C5, 1, 1 },
+                { 0x01C7, 0x01C7, 2, 1 }, { 0x01C8, 0x01C8, 1, 1 }, { 0x01CA, 0x01CA, 2, 1 },
+                { 0x01CB, 0x01DB, 1, 2 }, { 0x01DE, 0x01EE, 1, 2 }, { 0x01F1, 0x01F1, 2, 1 },
+                { 0x01F2, 0x01F4, 1, 2 }, { 0x01F6, 0x01F6, -97, 1 }, { 0x01F7, 0x01F7, -56, 1 },
+                { 0x01F8, 0x021E, 1, 2 }, { 0x0220, 0x0220, -130, 1 }, { 0x0222, 0x0232, 1, 2 },
+                { 0x023A, 0x023A, 10795, 1 }, { 0x023B, 0x023B, 1, 1 }, { 0x023D, 0x023D, -163, 1 },
+                { 0x023E, 0x023E, 10792, 1 }, { 0x0241, 0x0241, 1, 1 }, { 0x0243, 0x0243, -195, 1 },
+                { 0x0244, 0x0244, 69, 1 }, { 0x0245, 0x0245, 71, 1 }, { 0x0246, 0x024E, 1, 2 },
+                { 0x0345, 0x0345, 116, 1 }, { 0x0370, 0x0372, 1, 2 }, { 0x0376, 0x0376, 1, 1 },
+                { 0x037F, 0x037F, 116, 1 }, { 0x0386, 0x0386, 38, 1 }, { 0x0388, 0x038A, 37, 1 },
+                { 0x038C, 0x038C, 64, 1 }, { 0x038E, 0x038F, 63, 1 }, { 0x0391, 0x03A1, 32, 1 },
+                { 0x03A3, 0x03AB, 32, 1 }, { 0x03C2, 0x03C2, 1, 1 }, { 0x03CF, 0x03CF, 8, 1 },
+                { 0x03D0, 0x03D0, -30, 1 }, { 0x03D1, 0x03D1, -25, 1 }, { 0x03D5, 0x03D5, -15, 1 },
+                { 0x03D6, 0x03D6, -22, 1 }, { 0x03D8, 0x03EE, 1, 2 }, { 0x03F0, 0x03F0, -54, 1 },
+                { 0x03F1, 0x03F1, -48, 1 }, { 0x03F4, 0x03F4, -60, 1 }, { 0x03F5, 0x03F5, -64, 1 },
+                { 0x03F7, 0x03F7, 1, 1 }, { 0x03F9, 0x03F9, -7, 1 }, { 0x03FA, 0x03FA, 1, 1 },
+                { 0x03FD, 0x03FF, -130, 1 }, { 0x0400, 0x040F, 80, 1 }, { 0x0410, 0x042F, 32, 1 },
+                { 0x0460, 0x0480, 1, 2 }, { 0x048A, 0x04BE, 1, 2 }, { 0x04C0, 0x04C0, 15, 1 },
+                { 0x04C1, 0x04CD, 1, 2 }, { 0x04D0, 0x052E, 1, 2 }, { 0x0531, 0x0556, 48, 1 },
+                { 0x10A0, 0x10C5, 7264, 1 }, { 0x10C7, 0x10C7, 7264, 1 }, { 0x10CD, 0x10CD, 7264, 1 },
+                { 0x13F8, 0x13FD, -8, 1 }, { 0x1C80, 0x1C80, -6222, 1 }, { 0x1C81, 0x1C81, -6221, 1 },
+                { 0x1C82, 0x1C82, -6212, 1 }, { 0x1C83, 0x1C84, -6210, 1 }, { 0x1C85, 0x1C85, -6211, 1 },
+                { 0x1C86, 0x1C86, -6204, 1 }, { 0x1C87, 0x1C87, -6180, 1 }, { 0x1C88, 0x1C88, 35267, 1 },
+                { 0x1C90, 0x1CBA, -3008, 1 }, { 0x1CBD, 0x1CBF, -3008, 1 }, { 0x1E00, 0x1E94, 1, 2 },
+                { 0x1E9B, 0x1E9B, -58, 1 }, { 0x1E9E, 0x1E9E, -7615, 1 }, { 0x1EA0, 0x1EFE, 1, 2 },
+                { 0x1F08, 0x1F0F, -8, 1 }, { 0x1F18, 0x1F1D, -8, 1 }, { 0x1F28, 0x1F2F, -8, 1 },
+                { 0x1F38, 0x1F3F, -8, 1 }, { 0x1F48, 0x1F4D, -8, 1 }, { 0x1F59, 0x1F5F, -8, 2 },
+                { 0x1F68, 0x1F6F, -8, 1 }, { 0x1F88, 0x1F8F, -8, 1 }, { 0x1F98, 0x1F9F, -8, 1 },
+                { 0x1FA8, 0x1FAF, -8, 1 }, { 0x1FB8, 0x1FB9, -8, 1 }, { 0x1FBA, 0x1FBB, -74, 1 },
+                { 0x1FBC, 0x1FBC, -9, 1 }, { 0x1FBE, 0x1FBE, -7173, 1 }, { 0x1FC8, 0x1FCB, -86, 1 },
+                { 0x1FCC, 0x1FCC, -9, 1 }, { 0x1FD8, 0x1FD9, -8, 1 }, { 0x1FDA, 0x1FDB, -100, 1 },
+                { 0x1FE8, 0x1FE9, -8, 1 }, { 0x1FEA, 0x1FEB, -112, 1 }, { 0x1FEC, 0x1FEC, -7, 1 },
+                { 0x1FF8, 0x1FF9, -128, 1 }, { 0x1FFA, 0x1FFB, -126, 1 }, { 0x1FFC, 0x1FFC, -9, 1 },
+                { 0x2126, 0x2126, -7517, 1 }, { 0x212A, 0x212A, -8383, 1 }, { 0x212B, 0x212B, -8262, 1 },
+                { 0x2132, 0x2132, 28, 1 }, { 0x2160, 0x216F, 16, 1 }, { 0x2183, 0x2183, 1, 1 },
+                { 0x24B6, 0x24CF, 26, 1 }, { 0x2C00, 0x2C2F, 48, 1 }, { 0x2C60, 0x2C60, 1, 1 },
+                { 0x2C62, 0x2C62, -10743, 1 }, { 0x2C63, 0x2C63, -3814, 1 }, { 0x2C64, 0x2C64, -10727, 1 },
+                { 0x2C67, 0x2C6B, 1, 2 }, { 0x2C6D, 0x2C6D, -10780, 1 }, { 0x2C6E, 0x2C6E, -10749, 1 },
+                { 0x2C6F, 0x2C6F, -10783, 1 }, { 0x2C70, 0x2C70, -10782, 1 }, { 0x2C72, 0x2C72, 1, 1 },
+                { 0x2C75, 0x2C75, 1, 1 }, { 0x2C7E, 0x2C7F, -10815, 1 }, { 0x2C80, 0x2CE2, 1, 2 },
+                { 0x2CEB, 0x2CED, 1, 2 }, { 0x2CF2, 0x2CF2, 1, 1 }, { 0xA640, 0xA66C, 1, 2 },
+                { 0xA680, 0xA69A, 1, 2 }, { 0xA722, 0xA72E, 1, 2 }, { 0xA732, 0xA76E, 1, 2 },
+                { 0xA779, 0xA77B, 1, 2 }, { 0xA77D, 0xA77D, -35332, 1 }, { 0xA77E, 0xA786, 1, 2 },
+                { 0xA78B, 0xA78B, 1, 1 }, { 0xA78D, 0xA78D, -42280, 1 }, { 0xA790, 0xA792, 1, 2 },
+                { 0xA796, 0xA7A8, 1, 2 }, { 0xA7AA, 0xA7AA, -42308, 1 }, { 0xA7AB, 0xA7AB, -42319, 1 },
+                { 0xA7AC, 0xA7AC, -42315, 1 }, { 0xA7AD, 0xA7AD, -42305, 1 }, { 0xA7AE, 0xA7AE, -42308, 1 },
+                { 0xA7B0, 0xA7B0, -42258, 1 }, { 0xA7B1, 0xA7B1, -42282, 1 }, { 0xA7B2, 0xA7B2, -42261, 1 },
+                { 0xA7B3, 0xA7B3, 928, 1 }, { 0xA7B4, 0xA7C2, 1, 2 }, { 0xA7C4, 0xA7C4, -48, 1 },
+                { 0xA7C5, 0xA7C5, -42307, 1 }, { 0xA7C6, 0xA7C6, -35384, 1 }, { 0xA7C7, 0xA7C9, 1, 2 },
+                { 0xA7D0, 0xA7D0, 1, 1 }, { 0xA7D6, 0xA7D8, 1, 2 }, { 0xA7F5, 0xA7F5, 1, 1 },
+                { 0xAB70, 0xABBF, -38864, 1 }, { 0xFF21, 0xFF3A, 32, 1 }, { 0x10400, 0x10427, 40, 1 },
+                { 0x104B0, 0x104D3, 40, 1 }, { 0x10570, 0x1057A, 39, 1 }, { 0x1057C, 0x1058A, 39, 1 },
+                { 0x1058C, 0x10592, 39, 1 }, { 0x10594, 0x10595, 39, 1 }, { 0x10C80, 0x10CB2, 64, 1 },
+                { 0x118A0, 0x118BF, 32, 1 }, { 0x16E40, 0x16E5F, 32, 1 }, { 0x1E900, 0x1E921, 34, 1 }
+        };
+        size_t lo = 0, hi = sizeof( ranges ) / sizeof( ranges[0] );
+        while ( lo < hi ) // first range with last >= ch
+        {
+            size_t mid = ( lo + hi ) / 2;
+            if ( ranges[mid].last < ch )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if ( lo == sizeof( ranges ) / sizeof( ranges[0] ) || ch < ranges[lo].first ||
+             ( ch - ranges[lo].first ) % ranges[lo].stride != 0 )
+            return ch;
+        return char32_t( int32_t( ch ) + ranges[lo].delta );
+    }
+
+    // End of the run of ASCII bytes starting at begin
+    inline const char* _ascii_end( const char* begin, const char* end )
+    {
+        for ( ; end - begin >= 16; begin += 16 )
+        {
+            int mask = _mm_movemask_epi8( _mm_loadu_si128( ( const __m128i* )begin ) );
+            if ( mask )
+                return begin + bit_scan_forward( uint64_t( mask ) );
+        }
+        while ( begin < end && uint8_t( *begin ) < 0x80 )
+        {
+            ++begin;
+        }
+        return begin;
+    }
+
+    // Folded copy (ASCII runs are converted 16 bytes at a time, malformed sequences are kept as is)
+    inline u8string fold_case( u8string_view str )
+    {
+        std::string result;
+        result.reserve( str.size( ) );
+        const char* end = str.data( ) + str.size( );
+        for ( const char* p = str.data( ); p < end; )
+        {
+            const char* run = _ascii_end( p, end );
+            if ( run > p )
+            {
+                size_t used = result.size( );
+                result.resize( used + ( run - p ) );
+                _ascii_case<false>( p, run - p, &result[used] );
+                p = run;
+                continue;
+            }
+            char32_t ch;
+            const char* next = utf8::decode( p, end, ch );
+            char32_t folded  = fold_case( ch );
+            if ( folded == ch )
+            {
+                result.append( p, next );
+            }
+            else
+            {
+                char buffer[4];
+                result.append( buffer, utf8::encode( buffer, folded ) );
+            }
+            p = next;
+        }
+        return u8string( std::move( result ) );
+    }
+
+    // Case-insensitive comparison of folded code points, no folded copy is built.
+    // Both sides are compared 16 bytes at a time while they are ASCII, malformed sequences count
+    // as REPL_CHAR
+    inline int icompare( u8string_view lh, u8string_view rh )
+    {
+        const char* a     = lh.data( );
+        const char* a_end = a + lh.size( );
+        const char* b     = rh.data( );
+        const char* b_end = b + rh.size( );
+        for ( ;; )
+        {
+#if defined( DMK_ARCH_AVX2 )
+            for ( ; a_end - a >= 32 && b_end - b >= 32; a += 32, b += 32 )
+            {
+                __m256i x = _mm256_loadu_si256( ( const __m256i* )a );
+                __m256i y = _mm256_loadu_si256( ( const __m256i* )b );
+                if ( _mm256_movemask_epi8( _mm256_or_si256( x, y ) ) )
+                    break;
+                __m256i same  = _mm256_cmpeq_epi8( _ascii_case32<false>( x ), _ascii_case32<false>( y ) );
+                uint32_t diff = ~uint32_t( _mm256_movemask_epi8( same ) );
+                if ( diff )
+                {
+                    size_t i = bit_scan_forward( diff );
+                    return asci_lowercase( a[i] ) < asci_lowercase( b[i] ) ? -1 : 1;
+                }
+            }
+#endif
+            for ( ; a_end - a >= 16 && b_end - b >= 16; a += 16, b += 16 )
+            {
+                __m128i x = _mm_loadu_si128( ( const __m128i* )a );
+                __m128i y = _mm_loadu_si128( ( const __m128i* )b );
+                if ( _mm_movemask_epi8( _mm_or_si128( x, y ) ) )
+                    break;
+                __m128i same  = _mm_cmpeq_epi8( _ascii_case16<false>( x ), _ascii_case16<false>( y ) );
+                uint32_t diff = ~uint32_t( _mm_movemask_epi8( same ) ) & 0xFFFF;
+                if ( diff )
+                {
+                    size_t i = bit_scan_forward( diff );
+                    return asci_lowercase( a[i] ) < asci_lowercase( b[i] ) ? -1 : 1;
+                }
+            }
+            if ( a == a_end || b == b_end )
+                return a != a_end ? 1 : b != b_end ? -1 : 0;
+            char32_t x, y;
+            if ( uint8_t( *a | *b ) < 0x80 )
+            {
+                x = uint8_t( asci_lowercase( *a++ ) );
+                y = uint8_t( asci_lowercase( *b++ ) );
+            }
+            else
+            {
+                a = utf8::decode( a, a_end, x );
+                b = utf8::decode( b, b_end, y );
+                x = fold_case( x );
+                y = fold_case( y );
+            }
+            if ( x != y )
+                return x < y ? -1 : 1;
+        }
+    }
+
+    inline bool iequals( u8string_view lh, u8string_view rh )
+    {
+        return icompare( lh, rh ) == 0;
+    }
+
+    // Folds code points from p into buffer while 4 bytes of room remain, returns the bytes written
+    inline size_t _fold_chunk( const char*& p, const char* end, char* buffer, size_t capacity )
+    {
+        size_t used = 0;
+        while ( p < end && used + 4 <= capacity )
+        {
+            size_t room     = capacity - used;
+            const char* run = _ascii_end( p, size_t( end - p ) < room ? end : p + room );
+            if ( run > p )
+            {
+                _ascii_case<false>( p, run - p, buffer + used );
+                used += run - p;
+                p = run;
+                continue;
+            }
+            char32_t ch;
+            p    = utf8::decode( p, end, ch );
+            used = utf8::encode( buffer + used, fold_case( ch ) ) - buffer;
+        }
+        return used;
+    }
+
+    // hash( ) of the folded code points, fed through a small stack buffer instead of a folded copy.
+    // iequals( a, b ) implies ihash( a ) == ihash( b ), for valid UTF-8 ihash( s ) == hash( fold_case( s ) )
+    inline uint64_t ihash( u8string_view str, uint64_t seed = 0 )
+    {
+        char buffer[_hash::ShortLimit];
+        const char* p   = str.data( );
+        const char* end = p + str.size( );
+        size_t used     = _fold_chunk( p, end, buffer, sizeof( buffer ) );
+        // a single chunk always takes the short path of hash( ), call it directly so the striped
+        // path is never instantiated over the stack buffer
+        if ( p == end )
+            return _hash::short_hash( reinterpret_cast<const uint8_t*>( buffer ), used, seed );
+        hasher state( seed );
+        state.update( buffer, used );
+        while ( p < end )
+        {
+            used = _fold_chunk( p, end, buffer, sizeof( buffer ) );
+            state.update( buffer, used );
+        }
+        return state.digest( );
+    }
+
+    // Byte length of the prefix of [text, text_end) that case-insensitively equals pattern, npos if none
+    inline size_t _imatch( const char* text, const char* text_end, u8string_view pattern )
+    {
+        const char* p     = text;
+        const char* q     = pattern.data( );
+        const char* q_end = q + pattern.size( );
+        while ( q < q_end )
+        {
+            if ( p == text_end )
+                return u8string_view::npos;
+            if ( uint8_t( *p | *q ) < 0x80 )
+            {
+                if ( asci_lowercase( *p++ ) != asci_lowercase( *q++ ) )
+                    return u8string_view::npos;
+                continue;
+            }
+            char32_t x, y;
+            p = utf8::decode( p, text_end, x );
+            q = utf8::decode( q, q_end, y );
+            if ( fold_case( x ) != fold_case( y ) )
+                return u8string_view::npos;
+        }
+        return size_t( p - text );
+    }
+
+    // Byte position of the first case-insensitive occurrence of pattern at or after offset (npos if none).
+    // Candidates are both cases of an ASCII first code point plus every non-ASCII code point
+    // (U+212A KELVIN SIGN folds to 'k'), found 16 bytes at a time and then verified
+    inline size_t ifind( u8string_view text, u8string_view pattern, size_t offset = 0 )
+    {
+        if ( offset > text.size( ) )
+            return u8string_view::npos;
+        if ( pattern.empty( ) )
+            return offset;
+        char32_t first;
+        utf8::decode( pattern.data( ), pattern.data( ) + pattern.size( ), first );
+        first = fold_case( first );
+        // a non-ASCII first code point only needs the bytes >= 0x80 that are added to every mask below
+        const char lower  = first < 0x80 ? char( first ) : char( 0x80 );
+        const char upper  = asci_uppercase( lower );
+        const __m128i lo  = _mm_set1_epi8( lower );
+        const __m128i up  = _mm_set1_epi8( upper );
+        const char* begin = text.data( );
+        const char* end   = begin + text.size( );
+        for ( const char* p = begin + offset; p < end; )
+        {
+            uint32_t mask = 0;
+            size_t span   = end - p < 16 ? size_t( end - p ) : 16;
+            if ( span == 16 )
+            {
+                __m128i x    = _mm_loadu_si128( ( const __m128i* )p );
+                __m128i same = _mm_or_si128( _mm_cmpeq_epi8( x, lo ), _mm_cmpeq_epi8( x, up ) );
+                mask         = _mm_movemask_epi8( same ) | _mm_movemask_epi8( x );
+            }
+            else
+            {
+                for ( size_t i = 0; i < span; i++ )
+                {
+                    if ( p[i] == lower || p[i] == upper || uint8_t( p[i] ) >= 0x80 )
+                        mask |= 1u << i;
+                }
+            }
+            for ( ; mask; mask &= mask - 1 )
+            {
+                const char* candidate = p + bit_scan_forward( mask );
+                if ( utf8::is_start( begin, candidate ) &&
+                     _imatch( candidate, end, pattern ) != u8string_view::npos )
+                    return size_t( candidate - begin );
+            }
+            p += span;
+        }
+        return u8string_view::npos;
+    }
+
+    // Function objects for case-insensitive unordered containers, e.g.
+    //     std::unordered_map<std::string, value, icase_hash, icase_equal> headers;
+    struct icase_hash
+    {
+        size_t operator( )( u8string_view str ) const
+        {
+            return size_t( ihash( str ) );
+        }
+    };
+
+    struct icase_equal
+    {
+        bool operator( )( u8string_view lh, u8string_view rh ) const
+        {
+            return iequals( lh, rh );
+        }
+    };
+
+    struct icase_less
+    {
+        bool operator( )( u8string_view lh, u8string_view rh ) const
+        {
+            return icompare( lh, rh ) < 0;
+        }
+    };
+
+    // Pattern compiled once, matched without allocation:
+    //     *        any run of code points (also empty)
+    //     ?        exactly one code point
+    //     [a-z_]   one code point from the class, [!a-z] or [^a-z] one not in it
+    //     \x       x literally
+    //     !...     (leading) negates the whole pattern
+    // The pattern splits at '*' into fixed-length segments: the first is matched at the start of the
+    // text, the last at the end and the ones between at their leftmost position, so there is no
+    // backtracking
+    struct glob
+    {
+    public:
+        // the empty pattern matches only the empty text
+        glob( u8string_view pattern = u8string_view( ) )
+            : m_negated( false ), m_min_size( 0 ), m_segment_length( 0 ), m_prefix( 0, 0 ), m_suffix( 0, 0 )
+        {
+            m_segments.push_back( 0 );
+            compile( pattern );
+        }
+        glob( const char* pattern ) : glob( u8string_view( pattern ) )
+        {
+        }
+
+        bool matches( u8string_view text ) const
+        {
+            return match_raw( text ) != m_negated;
+        }
+
+        bool negated( ) const
+        {
+            return m_negated;
+        }
+        // literal text every match starts/ends with (ignoring negation)
+        u8string_view prefix( ) const
+        {
+            return u8string_view( m_literals.data( ) + m_prefix.first, m_prefix.second );
+        }
+        u8string_view suffix( ) const
+        {
+            return u8string_view( m_literals.data( ) + m_suffix.first, m_suffix.second );
+        }
+        // fewest bytes a match can have (ignoring negation)
+        size_t min_size( ) const
+        {
+            return m_min_size;
+        }
+        // false if the text can not match, judging by prefix, suffix and size only
+        bool prefilter( u8string_view text ) const
+        {
+            return text.size( ) >= m_min_size && text.starts_with( prefix( ) ) && text.ends_with( suffix( ) );
+        }
+
+        // match ignoring negation
+        bool match_raw( u8string_view text ) const
+        {
+            if ( !prefilter( text ) )
+                return false;
+            const char* p   = text.data( );
+            const char* end = p + text.size( );
+            size_t last     = m_segments.size( ) - 2;
+            if ( last == 0 )
+                return match_at( 0, p, end ) == end;
+            p = match_at( 0, p, end );
+            if ( !p )
+                return false;
+            // the last segment takes a fixed number of code points at the end
+            const char* tail = end;
+            for ( size_t n = m_segment_lengths[last]; n > 0 && tail > p; n-- )
+            {
+                while ( --tail > p && !utf8::is_start( p, tail ) )
+                {
+                }
+            }
+            if ( tail < p || match_at( last, tail, end ) != end )
+                return false;
+            for ( size_t segment = 1; segment < last; segment++ )
+            {
+                p = find_segment( segment, p, tail );
+                if ( !p )
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        enum class element_type : uint8_t
+        {
+            literal, // bytes m_literals[offset, offset + size)
+            any,
+            range, // m_ranges[offset, offset + size)
+            negated_range
+        };
+
+        struct element
+        {
+            element_type type;
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        void compile( u8string_view pattern )
+        {
+            const char* p   = pattern.data( );
+            const char* end = p + pattern.size( );
+            if ( p < end && *p == '!' )
+            {
+                m_negated = true;
+                p++;
+            }
+            while ( p < end )
+            {
+                char c = *p;
+                if ( c == '*' )
+                {
+                    p++;
+                    end_segment( );
+                }
+                else if ( c == '?' )
+                {
+                    p++;
+                    add( element_type::any, 0, 0 );
+                    m_min_size++;
+                }
+                else if ( c == '[' && compile_class( p, end ) )
+                {
+                    m_min_size++;
+                }
+                else
+                {
+                    if ( c == '\\' && p + 1 < end )
+                        p++;
+                    const char* next = utf8::next( p, end );
+                    add_literal( p, next );
+                    p = next;
+                }
+            }
+            end_segment( );
+            // prefix: leading literal of the first segment, suffix: trailing literal of the last
+            const element* first = m_elements.data( );
+            if ( m_segments[1] > 0 && first->type == element_type::literal )
+                m_prefix = std::make_pair( first->offset, first->size );
+            size_t last_begin = m_segments[m_segments.size( ) - 2];
+            size_t last_end   = m_segments.back( );
+            if ( last_end > last_begin && m_elements[last_end - 1].type == element_type::literal )
+            {
+                const element& e = m_elements[last_end - 1];
+                m_suffix         = std::make_pair( e.offset, e.size );
+            }
+        }
+
+        // [...] at p, false (and p unchanged) if the class is not terminated
+        bool compile_class( const char*& p, const char* end )
+        {
+            const char* q = p + 1;
+            bool negated  = q < end && ( *q == '!' || *q == '^' );
+            if ( negated )
+                q++;
+            uint32_t offset = uint32_t( m_ranges.size( ) );
+            bool first      = true;
+            while ( q < end && ( *q != ']' || first ) )
+            {
+                first = false;
+                char32_t low;
+                if ( *q == '\\' && q + 1 < end )
+                    q++;
+                q             = utf8::decode( q, end, low );
+                char32_t high = low;
+                if ( q + 1 < end && *q == '-' && q[1] != ']' )
+                {
+                    q++;
+                    if ( *q == '\\' && q + 1 < end )
+                        q++;
+                    q = utf8::decode( q, end, high );
+                }
+                m_ranges.push_back( std::make_pair( low, high ) );
+            }
+            if ( q >= end )
+            {
+                m_ranges.resize( offset );
+                return false;
+            }
+            add( negated ? element_type::negated_range : element_type::range,
+                 offset,
+                 uint32_t( m_ranges.size( ) - offset ) );
+            p = q + 1;
+            return true;
+        }
+
+        void add( element_type type, uint32_t offset, uint32_t size )
+        {
+            element e = { type, offset, size };
+            m_elements.push_back( e );
+            m_segment_length++;
+        }
+
+        void add_literal( const char* first, const char* last )
+        {
+            m_min_size += last - first;
+            size_t segment_begin = m_segments.back( );
+            if ( m_elements.size( ) > segment_begin && m_elements.back( ).type == element_type::literal )
+            {
+                m_elements.back( ).size += uint32_t( last - first );
+                m_segment_length++;
+            }
+            else
+            {
+                add( element_type::literal, uint32_t( m_literals.size( ) ), uint32_t( last - first ) );
+            }
+            m_literals.append( first, last );
+        }
+
+        // m_segments: element index where each segment starts, plus the end
+        void end_segment( )
+        {
+            m_segments.push_back( m_elements.size( ) );
+            m_segment_lengths.push_back( m_segment_length );
+            m_segment_length = 0;
+        }
+
+        static bool in_ranges( const std::pair<char32_t, char32_t>* ranges, size_t count, char32_t c )
+        {
+            for ( size_t i = 0; i < count; i++ )
+            {
+                if ( c >= ranges[i].first && c <= ranges[i].second )
+                    return true;
+            }
+            return false;
+        }
+
+        // end of the segment matched at p, nullptr if it does not match there
+        const char* match_at( size_t segment, const char* p, const char* end ) const
+        {
+            for ( size_t i = m_segments[segment]; i < m_segments[segment + 1]; i++ )
+            {
+                const element& e = m_elements[i];
+                if ( e.type == element_type::literal )
+                {
+                    if ( size_t( end - p ) < e.size ||
+                         std::memcmp( p, m_literals.data( ) + e.offset, e.size ) != 0 )
+                        return nullptr;
+                    p += e.size;
+                    continue;
+                }
+                if ( p >= end )
+                    return nullptr;
+                if ( e.type == element_type::any )
+                {
+                    p = utf8::next( p, end );
+                    continue;
+                }
+                char32_t c;
+                p = utf8::decode( p, end, c );
+                if ( in_ranges( m_ranges.data( ) + e.offset, e.size, c ) !=
+                     ( e.type == element_type::range ) )
+                    return nullptr;
+            }
+            return p;
+        }
+
+        // leftmost match of the segment within [p, end), returns its end
+        const char* find_segment( size_t segment, const char* p, const char* end ) const
+        {
+            if ( m_segments[segment] == m_segments[segment + 1] )
+                return p; // "**"
+            const element& head = m_elements[m_segments[segment]];
+            while ( p < end )
+            {
+                if ( head.type == element_type::literal )
+                {
+                    size_t pos = u8string_view( p, end ).find_bytes(
+                        u8string_view( m_literals.data( ) + head.offset, head.size ) );
+                    if ( pos == u8string_view::npos )
+                        return nullptr;
+                    p += pos;
+                }
+                if ( const char* found = match_at( segment, p, end ) )
+                    return found;
+                p = utf8::next( p, end );
+            }
+            return nullptr;
+        }
+
+        bool m_negated;
+        size_t m_min_size;
+        size_t m_segment_length; // code points in the segment being compiled
+        std::vector<element> m_elements;
+        std::vector<size_t> m_segments;        // first element of every segment, plus the end
+        std::vector<size_t> m_segment_lengths; // code points per segment
+        std::vector<std::pair<char32_t, char32_t>> m_ranges;
+        std::string m_literals;
+        std::pair<uint32_t, uint32_t> m_prefix; // offset and size in m_literals
+        std::pair<uint32_t, uint32_t> m_suffix;
+    };
+
+    // Many patterns against many strings. Patterns starting with '!' exclude, the others include:
+    // a text passes if it matches an include pattern (or there are none) and no exclude pattern.
+    // Patterns are indexed by their literal prefix (sorted, one table per prefix length), so a text
+    // is only tried against the patterns whose prefix it starts with
+    struct glob_set
+    {
+    public:
+        glob_set( )
+        {
+        }
+        glob_set( std::initializer_list<u8string_view> patterns )
+        {
+            for ( u8string_view pattern : patterns )
+            {
+                add( pattern );
+            }
+        }
+        template <typename _Iterator>
+        glob_set( _Iterator first, _Iterator last )
+        {
+            for ( ; first != last; ++first )
+            {
+                add( u8string_view( *first ) );
+            }
+        }
+
+        void add( u8string_view pattern )
+        {
+            glob compiled( pattern );
+            ( compiled.negated( ) ? m_exclude : m_include ).add( std::move( compiled ) );
+        }
+
+        bool matches( u8string_view text ) const
+        {
+            return ( m_include.empty( ) || m_include.any( text ) ) && !m_exclude.any( text );
+        }
+
+        // copies the texts that pass to out, returns out
+        template <typename _Iterator, typename _Output>
+        _Output filter( _Iterator first, _Iterator last, _Output out ) const
+        {
+            for ( ; first != last; ++first )
+            {
+                if ( matches( u8string_view( *first ) ) )
+                    *out++ = *first;
+            }
+            return out;
+        }
+
+    private:
+        struct group
+        {
+        public:
+            void add( glob&& pattern )
+            {
+                size_t length  = pattern.prefix( ).size( );
+                uint32_t index = uint32_t( m_globs.size( ) );
+                m_globs.push_back( std::move( pattern ) );
+                if ( length == 0 )
+                {
+                    m_unprefixed.push_back( index );
+                    return;
+                }
+                prefix_table* table = nullptr;
+                for ( prefix_table& t : m_tables )
+                {
+                    if ( t.length == length )
+                        table = &t;
+                }
+                if ( !table )
+                {
+                    m_tables.push_back( prefix_table( ) );
+                    table         = &m_tables.back( );
+                    table->length = length;
+                }
+                // prefix views point into the globs, which may have moved: keep indices only
+                std::vector<uint32_t>& entries = table->entries;
+                entries.insert( std::upper_bound( entries.begin( ),
+                                                  entries.end( ),
+                                                  index,
+                                                  [this]( uint32_t a, uint32_t b ) {
+                                                      return prefix_of( a ) < prefix_of( b );
+                                                  } ),
+                                index );
+            }
+            bool empty( ) const
+            {
+                return m_globs.empty( );
+            }
+            bool any( u8string_view text ) const
+            {
+                for ( const prefix_table& table : m_tables )
+                {
+                    if ( text.size( ) < table.length )
+                        continue;
+                    u8string_view head = text.bytes( 0, table.length );
+                    auto range         = std::equal_range( table.entries.begin( ),
+                                                   table.entries.end( ),
+                                                   head,
+                                                   prefix_less( this ) );
+                    for ( auto it = range.first; it != range.second; ++it )
+                    {
+                        if ( m_globs[*it].match_raw( text ) )
+                            return true;
+                    }
+                }
+                for ( uint32_t index : m_unprefixed )
+                {
+                    if ( m_globs[index].match_raw( text ) )
+                        return true;
+                }
+                return false;
+            }
 
-    inline u8string operator+( const char* lh, const u8string& rh )
-    {
-        return lh + rh.str( );
-    }
+        private:
+            struct prefix_table
+            {
+                size_t length;
+                std::vector<uint32_t> entries; // glob indices sorted by prefix
+            };
 
-    inline u8string operator+( const u8string& lh, const char* rh )
-    {
-        return lh.str( ) + rh;
-    }
+            // compares glob prefixes with a text head, for equal_range
+            struct prefix_less
+            {
+                const group* owner;
+                explicit prefix_less( const group* owner ) : owner( owner )
+                {
+                }
+                bool operator( )( uint32_t index, u8string_view head ) const
+                {
+                    return owner->prefix_of( index ) < head;
+                }
+                bool operator( )( u8string_view head, uint32_t index ) const
+                {
+                    return head < owner->prefix_of( index );
+                }
+            };
 
-    inline u8string& u8( std::string& str )
-    {
-        return reinterpret_cast<u8string&>( str );
-    }
+            u8string_view prefix_of( uint32_t index ) const
+            {
+                return m_globs[index].prefix( );
+            }
 
-    inline const u8string& u8( const std::string& str )
-    {
-        return reinterpret_cast<const u8string&>( str );
-    }
+            std::vector<glob> m_globs;
+            std::vector<prefix_table> m_tables;
+            std::vector<uint32_t> m_unprefixed;
+        };
 
-    inline std::ostream& operator<<( std::ostream& os, const u8string& str )
+        group m_include;
+        group m_exclude;
+    };
+
+    // Compiles the pattern on every call, keep a glob (or glob_set) for repeated matching
+    inline bool matches( u8string_view pattern, u8string_view text )
     {
-        os << str.str( );
-        return os;
+        return glob( pattern ).matches( text );
     }
 
-    inline std::string hex( const std::string& str )
+    inline std::string hex( u8string_view str )
     {
         std::string result = "";
-        for ( char c : str )
+        for ( const char* p = str.data( ); p < str.data( ) + str.size( ); p++ )
         {
+            char c = *p;
             if ( c < 0x20 || c >= 0x7F )
             {
                 result += fmt::format( "\\x{:02X}", uint8_t( c ) );
@@ -569,6 +2508,11 @@ namespace dmk
             }
             char32_t result;
             m_ptr8 = utf8::decode( m_ptr8, m_ptr8 + 5, result );
+            // a longer run of continuation bytes than decode looked at is still one code point
+            while ( utf8::is_continuation( *m_ptr8 ) )
+            {
+                ++m_ptr8;
+            }
             return result;
         }
         inline char32_t character32( ) const
@@ -600,66 +2544,569 @@ namespace dmk
         const uint32_t m_length;
     };
 
-    std::vector<std::string> tokenize( const std::string& str )
+    // Compile-time delimiter set: chars<' ', '\t'>
+    template <char... _Chars>
+    struct chars;
+
+    template <>
+    struct chars<>
     {
-        size_t param_end = 0;
-        std::vector<std::string> args;
-        while ( param_end < str.size( ) )
+    public:
+        bool contains( char ) const
         {
-            size_t param_start = str.find_first_not_of( ' ', param_end );
-            if ( param_start == std::string::npos )
-                break;
-            param_end = str.find_first_of( ' ', param_start );
-            if ( param_end == std::string::npos )
-                param_end = str.size( );
-            args.push_back( str.substr( param_start, param_end - param_start ) );
+            return false;
         }
-        return args;
+        __m128i match( __m128i ) const
+        {
+            return _mm_setzero_si128( );
+        }
+    };
+
+    template <char _First, char... _Rest>
+    struct chars<_First, _Rest...>
+    {
+    public:
+        bool contains( char c ) const
+        {
+            return c == _First || chars<_Rest...>( ).contains( c );
+        }
+        // 0xFF for every byte of v that is in the set
+        __m128i match( __m128i v ) const
+        {
+            __m128i first = _mm_cmpeq_epi8( v, _mm_set1_epi8( _First ) );
+            return _mm_or_si128( first, chars<_Rest...>( ).match( v ) );
+        }
+    };
+
+    typedef chars<' ', '\t', '\r', '\n'> whitespace;
+
+    // Run-time delimiter set, a 256-bit bitmap
+    struct char_set
+    {
+    public:
+        char_set( ) : m_bits( ), m_small( ), m_small_count( 0 )
+        {
+            build( );
+        }
+        char_set( u8string_view chars ) : m_bits( ), m_small( ), m_small_count( 0 )
+        {
+            for ( size_t i = 0; i < chars.size( ); i++ )
+            {
+                set( chars.data( )[i] );
+            }
+            build( );
+        }
+        char_set( const char* chars ) : char_set( u8string_view( chars ) )
+        {
+        }
+        bool contains( char c ) const
+        {
+            return ( m_bits[uint8_t( c ) >> 6] >> ( uint8_t( c ) & 63 ) ) & 1;
+        }
+        __m128i match( __m128i v ) const
+        {
+#if defined( DMK_ARCH_AVX )
+            // nibble lookup: the low nibble selects a byte of high-nibble bits, one table for
+            // high nibbles 0..7 and one for 8..15
+            __m128i low_nibble  = _mm_set1_epi8( 0x0F );
+            __m128i lo          = _mm_and_si128( v, low_nibble );
+            __m128i hi          = _mm_and_si128( _mm_srli_epi16( v, 4 ), low_nibble );
+            __m128i upper       = _mm_cmpgt_epi8( hi, _mm_set1_epi8( 7 ) );
+            __m128i bits        = _mm_or_si128( _mm_andnot_si128( upper, _mm_shuffle_epi8( m_lower, lo ) ),
+                                         _mm_and_si128( upper, _mm_shuffle_epi8( m_upper, lo ) ) );
+            __m128i bit         = _mm_shuffle_epi8( _mm_setr_epi8( 1, 2, 4, 8, 16, 32, 64, -128,
+                                                           1, 2, 4, 8, 16, 32, 64, -128 ), hi );
+            return _mm_cmpeq_epi8( _mm_and_si128( bits, bit ), bit );
+#else
+            if ( m_small_count <= sizeof( m_small ) )
+            {
+                __m128i result = _mm_setzero_si128( );
+                for ( size_t i = 0; i < m_small_count; i++ )
+                {
+                    result = _mm_or_si128( result, _mm_cmpeq_epi8( v, _mm_set1_epi8( m_small[i] ) ) );
+                }
+                return result;
+            }
+            alignas( 16 ) char bytes[16];
+            _mm_store_si128( ( __m128i* )bytes, v );
+            for ( char& c : bytes )
+            {
+                c = contains( c ) ? char( -1 ) : 0;
+            }
+            return _mm_load_si128( ( const __m128i* )bytes );
+#endif
+        }
+
+    private:
+        void set( char c )
+        {
+            if ( contains( c ) )
+                return;
+            m_bits[uint8_t( c ) >> 6] |= uint64_t( 1 ) << ( uint8_t( c ) & 63 );
+            if ( m_small_count < sizeof( m_small ) )
+                m_small[m_small_count] = c;
+            m_small_count++;
+        }
+
+        void build( )
+        {
+#if defined( DMK_ARCH_AVX )
+            alignas( 16 ) uint8_t lower[16] = {};
+            alignas( 16 ) uint8_t upper[16] = {};
+            for ( int c = 0; c < 256; c++ )
+            {
+                if ( contains( char( c ) ) )
+                    ( c < 128 ? lower : upper )[c & 15] |= uint8_t( 1 << ( ( c >> 4 ) & 7 ) );
+            }
+            m_lower = _mm_load_si128( ( const __m128i* )lower );
+            m_upper = _mm_load_si128( ( const __m128i* )upper );
+#endif
+        }
+
+        uint64_t m_bits[4];
+        char m_small[8]; // small sets are matched with one compare per character
+        size_t m_small_count;
+#if defined( DMK_ARCH_AVX )
+        __m128i m_lower;
+        __m128i m_upper;
+#endif
+    };
+
+    // Bit i set if p[i] is in the set, for 16 bytes
+    template <typename _Set>
+    inline uint64_t _match16( const _Set& set, const char* p )
+    {
+        return uint32_t( _mm_movemask_epi8( set.match( _mm_loadu_si128( ( const __m128i* )p ) ) ) );
     }
 
-    std::string replace_one( const std::string& str, const std::string& from, const std::string& to )
+    // First byte in [begin, end) that is (member = true) or is not (member = false) in the set,
+    // end if there is none. Scans 64 bytes per step
+    template <typename _Set>
+    inline const char* find_first( const char* begin, const char* end, const _Set& set, bool member )
     {
-        std::string r    = str;
-        size_t start_pos = 0;
-        if ( ( start_pos = r.find( from, start_pos ) ) != std::string::npos )
+        uint64_t flip = member ? 0 : ~uint64_t( 0 );
+        for ( ; end - begin >= 64; begin += 64 )
         {
-            r.replace( start_pos, from.size( ), to );
+            uint64_t mask = _match16( set, begin ) | _match16( set, begin + 16 ) << 16 |
+                            _match16( set, begin + 32 ) << 32 | _match16( set, begin + 48 ) << 48;
+            mask ^= flip;
+            if ( mask )
+                return begin + bit_scan_forward( mask );
         }
-        return r;
+        for ( ; end - begin >= 16; begin += 16 )
+        {
+            uint64_t mask = _match16( set, begin ) ^ ( flip & 0xFFFF );
+            if ( mask )
+                return begin + bit_scan_forward( mask );
+        }
+        for ( ; begin < end; begin++ )
+        {
+            if ( set.contains( *begin ) == member )
+                return begin;
+        }
+        return end;
+    }
+
+    enum class split_mode
+    {
+        merge_delimiters, // runs of delimiters separate tokens, no empty tokens (like tokenize)
+        keep_empty        // every delimiter ends a field, fields may be empty (like TSV)
+    };
+
+    // Lazy splitter yielding views, over one string:
+    //     for ( u8string_view field : splitter<chars<'\t'>>( line, {}, split_mode::keep_empty ) )
+    // or over a stream of chunks (mapped file, socket buffer):
+    //     splitter<> words;
+    //     while ( read( chunk ) ) { words.feed( chunk ); while ( words.next( token ) ) use( token ); }
+    //     words.finish( ); while ( words.next( token ) ) use( token );
+    // A token yielded from a chunk points into it (valid until the next feed), a token that spans
+    // chunks is assembled in an internal buffer (valid until the next call to next)
+    template <typename _Set = whitespace>
+    struct splitter
+    {
+    public:
+        struct const_iterator
+        {
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef u8string_view value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const u8string_view* pointer;
+            typedef const u8string_view& reference;
+
+        public:
+            const_iterator( ) : m_owner( nullptr )
+            {
+            }
+            explicit const_iterator( splitter* owner ) : m_owner( owner )
+            {
+                ++( *this );
+            }
+            const u8string_view& operator*( ) const
+            {
+                return m_token;
+            }
+            const u8string_view* operator->( ) const
+            {
+                return &m_token;
+            }
+            const_iterator& operator++( )
+            {
+                if ( m_owner && !m_owner->next( m_token ) )
+                    m_owner = nullptr;
+                return *this;
+            }
+            bool operator==( const const_iterator& it ) const
+            {
+                return m_owner == it.m_owner;
+            }
+            bool operator!=( const const_iterator& it ) const
+            {
+                return m_owner != it.m_owner;
+            }
+
+        private:
+            splitter* m_owner;
+            u8string_view m_token;
+        };
+
+    public:
+        explicit splitter( const _Set& delimiters = _Set( ), split_mode mode = split_mode::merge_delimiters )
+            : m_delimiters( delimiters ), m_mode( mode ), m_current( nullptr ), m_end( nullptr ),
+              m_open( false ), m_final( false ), m_release( false ), m_block( nullptr ), m_mask( 0 )
+        {
+        }
+        // whole input at once
+        explicit splitter( u8string_view text,
+                           const _Set& delimiters = _Set( ),
+                           split_mode mode        = split_mode::merge_delimiters )
+            : splitter( delimiters, mode )
+        {
+            feed( text );
+            finish( );
+        }
+
+        // next chunk of input, call after next( ) returned false
+        void feed( u8string_view chunk )
+        {
+            DMK_ASSERT_EQ( m_current, m_end );
+            m_current = chunk.data( );
+            m_end     = chunk.data( ) + chunk.size( );
+            m_block   = nullptr;
+        }
+        // no more input, the token at the end of the last chunk is yielded by next( )
+        void finish( )
+        {
+            m_final = true;
+        }
+
+        // false: the chunk is used up (or, after finish, there are no more tokens)
+        bool next( u8string_view& token )
+        {
+            if ( m_release )
+            {
+                m_carry.clear( );
+                m_release = false;
+            }
+            if ( m_current < m_end && !m_open )
+            {
+                if ( m_mode == split_mode::merge_delimiters )
+                {
+                    m_current = find( m_current, false );
+                    if ( m_current == m_end )
+                        return finish_token( token );
+                }
+                m_open = true;
+            }
+            if ( m_current == m_end )
+                return finish_token( token );
+            const char* delimiter = find( m_current, true );
+            if ( delimiter == m_end && !m_final )
+            {
+                // the token continues in the next chunk
+                m_carry.append( m_current, m_end );
+                m_current = m_end;
+                return false;
+            }
+            token_from( m_current, delimiter, token );
+            m_current = delimiter;
+            // in keep_empty mode a delimiter opens the next (maybe empty) field
+            m_open = false;
+            if ( delimiter < m_end )
+            {
+                m_current++;
+                m_open = m_mode == split_mode::keep_empty;
+            }
+            return true;
+        }
+
+        const_iterator begin( )
+        {
+            return const_iterator( this );
+        }
+        const_iterator end( )
+        {
+            return const_iterator( );
+        }
+
+    private:
+        // find_first, but the delimiter mask of a 64-byte block is kept for the following calls,
+        // so short tokens cost a few bit operations each
+        const char* find( const char* p, bool member )
+        {
+            for ( ;; )
+            {
+                if ( !m_block || p >= m_block + 64 )
+                {
+                    if ( m_end - p < 64 )
+                        return find_first( p, m_end, m_delimiters, member );
+                    m_block = p;
+                    m_mask  = _match16( m_delimiters, p ) | _match16( m_delimiters, p + 16 ) << 16 |
+                             _match16( m_delimiters, p + 32 ) << 32 | _match16( m_delimiters, p + 48 ) << 48;
+                }
+                uint64_t mask = ( member ? m_mask : ~m_mask ) & ( ~uint64_t( 0 ) << ( p - m_block ) );
+                if ( mask )
+                    return m_block + bit_scan_forward( mask );
+                p = m_block + 64;
+            }
+        }
+
+        void token_from( const char* first, const char* last, u8string_view& token )
+        {
+            if ( m_carry.empty( ) )
+            {
+                token = u8string_view( first, last );
+                return;
+            }
+            m_carry.append( first, last );
+            token     = u8string_view( m_carry );
+            m_release = true;
+        }
+
+        bool finish_token( u8string_view& token )
+        {
+            if ( !m_final || !m_open )
+                return false;
+            token_from( m_current, m_current, token );
+            m_open = false;
+            return true;
+        }
+
+        _Set m_delimiters;
+        split_mode m_mode;
+        const char* m_current;
+        const char* m_end;
+        bool m_open;    // a token has started and not ended yet (its beginning may be in m_carry)
+        bool m_final;   // finish( ) was called
+        bool m_release; // m_carry was handed out as a token, clear it on the next call
+        const char* m_block;
+        uint64_t m_mask; // delimiters in [m_block, m_block + 64)
+        std::string m_carry;
+    };
+
+    // Arguments of a typical command line fit inline, short tokens fit the string's own buffer
+    typedef small_vector<std::string, 8, malloc_allocator> token_list;
+    // Tokens pointing into the tokenized string, which must outlive them
+    typedef small_vector<u8string_view, 8, malloc_allocator> token_view_list;
+
+    // _List: any container of strings or views with emplace_back( const char*, size_t ),
+    // e.g. tokenize<token_view_list>( str ) or tokenize<std::vector<std::string>>( str )
+    template <typename _List = token_list>
+    _List tokenize( u8string_view str )
+    {
+        _List args;
+        for ( u8string_view token : splitter<chars<' '>>( str ) )
+        {
+            args.emplace_back( token.data( ), token.size( ) );
+        }
+        return args;
     }
 
-    std::string replace_all( const std::string& str, const std::string& from, const std::string& to )
+    inline std::string replace_one( u8string_view str, u8string_view from, u8string_view to )
     {
-        std::string r    = str;
+        std::string r    = str.str( );
         size_t start_pos = 0;
-        while ( ( start_pos = r.find( from, start_pos ) ) != std::string::npos )
+        if ( ( start_pos = str.find_bytes( from, start_pos ) ) != u8string_view::npos )
         {
-            r.replace( start_pos, from.size( ), to );
-            start_pos += to.size( );
+            r.replace( start_pos, from.size( ), to.data( ), to.size( ) );
         }
         return r;
     }
 
-    inline std::string q( const std::string& str )
+    // Counts the matches first, so the result is allocated once and every byte is copied once
+    inline std::string replace_all( u8string_view str, u8string_view from, u8string_view to )
     {
-        return '"' + str + '"';
+        if ( from.empty( ) )
+            return str.str( );
+        size_t count = 0;
+        size_t pos   = str.find_bytes( from );
+        while ( pos != u8string_view::npos )
+        {
+            count++;
+            pos = str.find_bytes( from, pos + from.size( ) );
+        }
+        if ( count == 0 )
+            return str.str( );
+        std::string r;
+        r.reserve( str.size( ) - count * from.size( ) + count * to.size( ) );
+        size_t copied = 0;
+        while ( ( pos = str.find_bytes( from, copied ) ) != u8string_view::npos )
+        {
+            r.append( str.data( ) + copied, pos - copied );
+            r.append( to.data( ), to.size( ) );
+            copied = pos + from.size( );
+        }
+        r.append( str.data( ) + copied, str.size( ) - copied );
+        return r;
     }
 
-    inline u8string q( const u8string& str )
+    // Applies many from -> to rules in one pass over the text. At every position the longest
+    // matching rule is replaced (leftmost-longest, matches do not overlap); positions whose byte
+    // can not start any rule are skipped with a SIMD scan. Compile once, apply many times:
+    //     multi_replacer escape{ { "&", "&amp;" }, { "<", "&lt;" }, { ">", "&gt;" } };
+    //     std::string html = escape.apply( text );
+    struct multi_replacer
     {
-        return q( str.str( ) );
-    }
+    public:
+        typedef std::pair<u8string_view, u8string_view> rule;
+
+    public:
+        multi_replacer( std::initializer_list<rule> rules )
+        {
+            compile( rules.begin( ), rules.end( ) );
+        }
+        // range of pairs of anything convertible to u8string_view
+        template <typename _Iterator>
+        multi_replacer( _Iterator first, _Iterator last )
+        {
+            compile( first, last );
+        }
+
+        // replaces into output (which is overwritten), returns the number of replacements
+        size_t apply( u8string_view text, std::string& output ) const
+        {
+            output.clear( );
+            output.reserve( text.size( ) );
+            const char* p      = text.data( );
+            const char* end    = p + text.size( );
+            const char* copied = p;
+            size_t count       = 0;
+            for ( ;; )
+            {
+                p = find_first( p, end, m_first, true );
+                if ( p == end )
+                    break;
+                int32_t best         = -1;
+                const char* best_end = p;
+                int32_t node         = 0;
+                for ( const char* q = p; q < end; )
+                {
+                    node = m_next[size_t( node ) * m_classes + m_class[uint8_t( *q++ )]];
+                    if ( !node )
+                        break;
+                    if ( m_rule[node] >= 0 )
+                    {
+                        best     = m_rule[node];
+                        best_end = q;
+                    }
+                }
+                if ( best < 0 )
+                {
+                    p++;
+                    continue;
+                }
+                output.append( copied, p );
+                output += m_to[best];
+                p = copied = best_end;
+                count++;
+            }
+            output.append( copied, end );
+            return count;
+        }
 
-    inline std::string qo( const std::string& str )
+        std::string apply( u8string_view text ) const
+        {
+            std::string output;
+            apply( text, output );
+            return output;
+        }
+
+    private:
+        // Trie over byte classes (bytes that occur in rules get classes 1..n, all others class 0
+        // which never has a transition), one dense row of m_classes entries per node
+        template <typename _Iterator>
+        void compile( _Iterator first, _Iterator last )
+        {
+            std::memset( m_class, 0, sizeof( m_class ) );
+            m_classes = 1;
+            std::string first_bytes;
+            for ( _Iterator it = first; it != last; ++it )
+            {
+                u8string_view from( it->first );
+                for ( size_t i = 0; i < from.size( ); i++ )
+                {
+                    uint16_t& c = m_class[uint8_t( from.data( )[i] )];
+                    if ( !c )
+                        c = uint16_t( m_classes++ );
+                }
+                if ( !from.empty( ) )
+                    first_bytes += from.front( );
+            }
+            m_first = char_set( first_bytes );
+            m_next.assign( m_classes, 0 );
+            m_rule.assign( 1, -1 );
+            for ( _Iterator it = first; it != last; ++it )
+            {
+                u8string_view from( it->first );
+                if ( from.empty( ) )
+                    continue;
+                int32_t node = 0;
+                for ( size_t i = 0; i < from.size( ); i++ )
+                {
+                    size_t slot = size_t( node ) * m_classes + m_class[uint8_t( from.data( )[i] )];
+                    if ( !m_next[slot] )
+                    {
+                        m_next[slot] = int32_t( m_rule.size( ) );
+                        m_rule.push_back( -1 );
+                        m_next.resize( m_next.size( ) + m_classes, 0 );
+                    }
+                    node = m_next[slot];
+                }
+                // the first rule for a pattern wins
+                if ( m_rule[node] < 0 )
+                {
+                    m_rule[node] = int32_t( m_to.size( ) );
+                    m_to.push_back( u8string_view( it->second ).str( ) );
+                }
+            }
+        }
+
+        uint16_t m_class[256]; // up to 256 classes besides 0 when the rules use every byte
+        size_t m_classes;
+        char_set m_first;              // bytes that start a rule
+        std::vector<int32_t> m_next;   // node * m_classes + class -> node, 0 = none
+        std::vector<int32_t> m_rule;   // node -> index in m_to of the rule ending there, -1 = none
+        std::vector<std::string> m_to;
+    };
+
+    inline std::string q( u8string_view str )
     {
-        if ( !str.empty( ) && str.find_first_of( " \"'<>&|?*$;" ) == std::string::npos )
-            return str;
-        return '"' + str + '"';
+        std::string result;
+        result.reserve( str.size( ) + 2 );
+        result += '"';
+        result.append( str.data( ), str.size( ) );
+        result += '"';
+        return result;
     }
 
-    inline u8string qo( const u8string& str )
+    inline std::string qo( u8string_view str )
     {
-        return qo( str.str( ) );
+        static const char special[] = " \"'<>&|?*$;";
+        const char* end             = str.data( ) + str.size( );
+        if ( !str.empty( ) &&
+             std::find_first_of( str.data( ), end, special, special + sizeof( special ) - 1 ) == end )
+            return str.str( );
+        return q( str );
     }
 
     template <typename _Type>
@@ -669,3 +3116,24 @@ namespace dmk
     }
 
 } // namespace dmk
+
+namespace std
+{
+    template <>
+    struct hash<dmk::u8string>
+    {
+        size_t operator( )( const dmk::u8string& str ) const
+        {
+            return size_t( dmk::hash( str.data( ), str.size( ) ) );
+        }
+    };
+
+    template <>
+    struct hash<dmk::u8string_view>
+    {
+        size_t operator( )( dmk::u8string_view str ) const
+        {
+            return size_t( dmk::hash( str.data( ), str.size( ) ) );
+        }
+    };
+} // namespace std
@@ -0,0 +1,331 @@
+// Container regression tests, a plain program without a test framework:
+//     cl /EHsc /std:c++14 /I.. /I<cppformat parent> memory_test.cpp && memory_test
+// Exits with the number of failed checks.
+#include "dmk_counter.h"
+#include "dmk_memory.h"
+#include "dmk_queue.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check( bool condition, const char* what )
+    {
+        if ( !condition )
+        {
+            std::printf( "FAILED: %s\n", what );
+            failures++;
+        }
+    }
+
+    // pushing an element of the container itself while it has to grow
+    void aligned_buffer_self_push( )
+    {
+        dmk::aligned_buffer<std::string> buffer;
+        buffer.push_back( "a string longer than the small string buffer" );
+        while ( buffer.size( ) < buffer.capacity( ) )
+        {
+            buffer.push_back( "filler" );
+        }
+        buffer.push_back( buffer[0] );
+        check( buffer.back( ) == buffer[0], "aligned_buffer push_back( v[0] ) while full" );
+        buffer.emplace_back( buffer[0] );
+        check( buffer.back( ) == buffer[0], "aligned_buffer emplace_back( v[0] )" );
+
+        dmk::aligned_buffer<std::string> filled( 1, "value" );
+        filled.resize( 64, filled[0] );
+        check( filled[63] == "value", "aligned_buffer resize( n, v[0] )" );
+
+        dmk::aligned_buffer<int> numbers;
+        for ( int i = 0; i < 100000; i++ )
+        {
+            numbers.push_back( numbers.empty( ) ? 7 : numbers[numbers.size( ) - 1] );
+        }
+        check( numbers.back( ) == 7, "paged aligned_buffer push_back( v.back( ) )" );
+    }
+
+    void small_vector_self_push( )
+    {
+        dmk::small_vector<std::string, 2> vector;
+        vector.push_back( "a string longer than the small string buffer" );
+        vector.push_back( "second" );
+        vector.push_back( vector[0] ); // inline storage is full, moves to the heap
+        check( vector.size( ) == 3 && vector[2] == vector[0],
+               "small_vector push_back( v[0] ) leaving inline storage" );
+        vector.push_back( "fourth" );
+        vector.emplace_back( vector[1] ); // heap storage is full
+        check( vector[4] == "second", "small_vector emplace_back( v[1] ) on the heap" );
+
+        dmk::small_vector<std::string, 1> filled( 1, "value" );
+        filled.resize( 16, filled[0] );
+        check( filled[15] == "value", "small_vector resize( n, v[0] )" );
+    }
+
+    // one producer and one consumer mixing single and batch calls, many laps of a small ring:
+    // items must come out in order
+    void spsc_queue_order( )
+    {
+        const uint64_t count = 100000;
+        dmk::spsc_queue<uint64_t> queue( 64 );
+        std::thread producer( [&] {
+            uint64_t batch[7];
+            unsigned spins = 0;
+            for ( uint64_t next = 1; next <= count; )
+            {
+                size_t pushed = 0;
+                if ( next % 3 == 0 )
+                {
+                    size_t size = next + 7 <= count + 1 ? 7 : size_t( count + 1 - next );
+                    for ( size_t i = 0; i < size; i++ )
+                    {
+                        batch[i] = next + i;
+                    }
+                    pushed = queue.push_batch( batch, size );
+                }
+                else
+                {
+                    pushed = queue.try_push( next ) ? 1 : 0;
+                }
+                next += pushed;
+                if ( !pushed )
+                    dmk::spin_wait( spins );
+            }
+        } );
+        uint64_t expected = 1, out_of_order = 0, sum = 0, batch[5];
+        unsigned spins = 0;
+        while ( expected <= count )
+        {
+            size_t popped = 0;
+            if ( expected % 2 == 0 )
+                popped = queue.pop_batch( batch, 5 );
+            else
+                popped = queue.try_pop( batch[0] ) ? 1 : 0;
+            if ( !popped )
+                dmk::spin_wait( spins );
+            for ( size_t i = 0; i < popped; i++, expected++ )
+            {
+                out_of_order += batch[i] != expected;
+                sum += batch[i];
+            }
+        }
+        producer.join( );
+        check( out_of_order == 0, "spsc_queue order" );
+        check( sum == count * ( count + 1 ) / 2 && queue.empty( ), "spsc_queue checksum" );
+    }
+
+    // several producers and consumers mixing single and batch calls: every item comes out once
+    void mpmc_queue_checksum( )
+    {
+        const int threads      = 4;
+        const uint64_t count   = 20000; // per producer
+        const uint64_t total   = threads * count;
+        dmk::mpmc_queue<uint64_t> queue( 32 );
+        std::atomic<uint64_t> popped( 0 ), sum( 0 ), squares( 0 );
+        std::vector<std::thread> workers;
+        for ( int t = 0; t < threads; t++ )
+        {
+            workers.emplace_back( [&, t] {
+                uint64_t batch[6];
+                unsigned spins = 0;
+                for ( uint64_t i = 0; i < count; )
+                {
+                    uint64_t value = uint64_t( t ) * count + i + 1;
+                    size_t pushed  = 0;
+                    if ( t % 2 )
+                    {
+                        size_t size = count - i < 6 ? size_t( count - i ) : 6;
+                        for ( size_t k = 0; k < size; k++ )
+                        {
+                            batch[k] = value + k;
+                        }
+                        pushed = queue.push_batch( batch, size );
+                    }
+                    else
+                    {
+                        pushed = queue.try_push( value ) ? 1 : 0;
+                    }
+                    i += pushed;
+                    if ( !pushed )
+                        dmk::spin_wait( spins );
+                }
+            } );
+            workers.emplace_back( [&, t] {
+                uint64_t batch[4];
+                unsigned spins = 0;
+                while ( popped.load( std::memory_order_relaxed ) < total )
+                {
+                    size_t n = t % 2 ? queue.pop_batch( batch, 4 ) : ( queue.try_pop( batch[0] ) ? 1 : 0 );
+                    if ( !n )
+                        dmk::spin_wait( spins );
+                    for ( size_t k = 0; k < n; k++ )
+                    {
+                        sum += batch[k];
+                        squares += batch[k] * batch[k];
+                    }
+                    popped += n;
+                }
+            } );
+        }
+        for ( std::thread& worker : workers )
+        {
+            worker.join( );
+        }
+        uint64_t expected_squares = total * ( total + 1 ) * ( 2 * total + 1 ) / 6;
+        check( popped == total && sum == total * ( total + 1 ) / 2, "mpmc_queue count and sum" );
+        check( squares == expected_squares && queue.empty( ), "mpmc_queue checksum" );
+    }
+
+    // blocks allocated by one thread and freed by another go back through the remote list
+    void scalable_remote_free( )
+    {
+        typedef dmk::scalable_allocator allocator;
+        const size_t count = 20000;
+        dmk::mpmc_queue<uint32_t*> handoff( 256 );
+        std::atomic<size_t> corrupted( 0 );
+        std::thread consumer( [&] {
+            unsigned spins = 0;
+            for ( size_t done = 0; done < count; )
+            {
+                uint32_t* block;
+                if ( !handoff.try_pop( block ) )
+                {
+                    dmk::spin_wait( spins );
+                    continue;
+                }
+                for ( uint32_t i = 1; i < block[0]; i++ )
+                {
+                    corrupted += block[i] != block[0] + i;
+                }
+                allocator::deallocate( block );
+                done++;
+            }
+        } );
+        unsigned spins = 0;
+        for ( size_t n = 0; n < count; n++ )
+        {
+            // a few size classes, refilled after the consumer's frees were collected
+            size_t size     = 16 + ( n % 5 ) * 48;
+            uint32_t* block = ( uint32_t* )allocator::allocate( size );
+            uint32_t words  = uint32_t( size / sizeof( uint32_t ) );
+            block[0]        = words;
+            for ( uint32_t i = 1; i < words; i++ )
+            {
+                block[i] = words + i;
+            }
+            while ( !handoff.try_push( block ) )
+            {
+                dmk::spin_wait( spins );
+            }
+        }
+        consumer.join( );
+        check( corrupted == 0, "scalable_allocator blocks freed by another thread" );
+    }
+
+    // segments of an exited thread are adopted by the next thread needing that size class
+    void scalable_adoption( )
+    {
+        typedef dmk::scalable_allocator allocator;
+        const size_t count = 100;
+        size_t size        = 3000;
+        std::vector<void*> blocks( count );
+        std::thread( [&] {
+            for ( void*& block : blocks )
+            {
+                block = allocator::allocate( size );
+                std::memset( block, 0x5A, size );
+            }
+        } ).join( );
+        // freed by a thread without a heap of its own: remote frees into the abandoned segment
+        for ( size_t i = 0; i < count; i += 2 )
+        {
+            allocator::deallocate( blocks[i] );
+        }
+        bool adopted = false, intact = true;
+        std::thread( [&] {
+            size_t segment = allocator::align_down<allocator::SegmentSize>( size_t( blocks[1] ) );
+            void* fresh    = allocator::allocate( size );
+            adopted        = allocator::align_down<allocator::SegmentSize>( size_t( fresh ) ) == segment;
+            std::vector<void*> more;
+            for ( size_t i = 0; i < count; i++ )
+            {
+                more.push_back( allocator::allocate( size ) );
+                std::memset( more.back( ), 0xA5, size );
+            }
+            for ( size_t i = 1; i < count; i += 2 )
+            {
+                const uint8_t* bytes = ( const uint8_t* )blocks[i];
+                intact               = intact && bytes[0] == 0x5A && bytes[size - 1] == 0x5A;
+                allocator::deallocate( blocks[i] );
+            }
+            for ( void* block : more )
+            {
+                allocator::deallocate( block );
+            }
+            allocator::deallocate( fresh );
+        } ).join( );
+        check( adopted, "scalable_allocator adopts an abandoned segment" );
+        check( intact, "scalable_allocator live blocks of an adopted segment" );
+    }
+
+    static_assert( alignof( dmk::sharded_counter::slot ) == dmk::CacheSize &&
+                       sizeof( dmk::sharded_counter::slot ) == dmk::CacheSize,
+                   "one counter slot per cache line" );
+
+    // concurrent adds, decrements and resets lose nothing, whatever the shard count
+    void sharded_counter_totals( size_t shards )
+    {
+        const int threads  = 8;
+        const int64_t adds = 20000;
+        dmk::sharded_counter counter( shards );
+        std::atomic<bool> done( false );
+        int64_t drained = 0;
+        std::thread resetter( [&] {
+            while ( !done.load( ) )
+            {
+                drained += counter.reset( );
+                std::this_thread::yield( );
+            }
+        } );
+        std::vector<std::thread> workers;
+        for ( int t = 0; t < threads; t++ )
+        {
+            workers.emplace_back( [&] {
+                for ( int64_t i = 1; i <= adds; i++ )
+                {
+                    counter += i;
+                    --counter;
+                }
+            } );
+        }
+        for ( std::thread& worker : workers )
+        {
+            worker.join( );
+        }
+        done = true;
+        resetter.join( );
+        int64_t expected = threads * ( adds * ( adds + 1 ) / 2 - adds );
+        check( drained + counter.value( ) == expected, "sharded_counter total" );
+        size_t count = counter.shards( );
+        check( ( count & ( count - 1 ) ) == 0 && count >= shards, "sharded_counter shards" );
+    }
+} // namespace
+
+int main( )
+{
+    aligned_buffer_self_push( );
+    small_vector_self_push( );
+    spsc_queue_order( );
+    mpmc_queue_checksum( );
+    scalable_remote_free( );
+    scalable_adoption( );
+    sharded_counter_totals( 0 );
+    sharded_counter_totals( 1 );
+    sharded_counter_totals( 3 );
+    std::printf( "%d failures\n", failures );
+    return failures;
+}
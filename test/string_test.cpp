@@ -0,0 +1,373 @@
+// UTF-8 regression tests, a plain program without a test framework:
+//     cl /EHsc /std:c++14 /I.. /I<cppformat parent> string_test.cpp && string_test
+// Exits with the number of failed checks.
+#include "dmk_intern.h"
+#include "dmk_string.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check( bool condition, const char* what, const char* input )
+    {
+        if ( !condition )
+        {
+            std::printf( "FAILED: %s for \"", what );
+            for ( const char* p = input; *p; p++ )
+            {
+                std::printf( uint8_t( *p ) < 0x80 ? "%c" : "\\x%02X", uint8_t( *p ) );
+            }
+            std::printf( "\"\n" );
+            failures++;
+        }
+    }
+
+    // decode, next, advance, length and both iterators must split malformed input the same way
+    void malformed_input( const char* input )
+    {
+        const char* begin = input;
+        const char* end   = input + std::strlen( input );
+
+        std::vector<const char*> starts;
+        std::vector<char32_t> values;
+        for ( const char* p = begin; p < end; )
+        {
+            char32_t ch;
+            starts.push_back( p );
+            p = dmk::utf8::decode( p, end, ch );
+            values.push_back( ch );
+        }
+        size_t count = starts.size( );
+        check( dmk::utf8::length( begin, end ) == count, "utf8::length", input );
+
+        size_t next_count = 0;
+        for ( const char* p = begin; p < end; p = dmk::utf8::next( p, end ), next_count++ )
+        {
+            check( next_count < count && p == starts[next_count], "utf8::next position", input );
+        }
+        check( next_count == count, "utf8::next count", input );
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            check( dmk::utf8::advance( begin, end, i ) == starts[i], "utf8::advance", input );
+        }
+
+        dmk::u8string str( input );
+        check( str.length( ) == count, "u8string::length", input );
+        size_t i = 0;
+        for ( dmk::u8string::const_iterator it = str.begin( ); it != str.end( ); ++it, i++ )
+        {
+            check( i < count && *it == values[i], "u8string::const_iterator", input );
+        }
+        check( i == count, "u8string::const_iterator count", input );
+
+        dmk::string_iterator chars( input );
+        check( chars.length( ) == count, "string_iterator::length", input );
+        for ( i = 0; !chars.empty( ); i++ )
+        {
+            char32_t ch = chars.next( );
+            check( i < count && ch == values[i], "string_iterator::next", input );
+        }
+        check( i == count, "string_iterator count", input );
+
+        std::u32string wide = dmk::u8_u32( input );
+        check( wide == std::u32string( values.begin( ), values.end( ) ), "u8_u32", input );
+
+        // case-insensitive comparison and hashing see the same code points as decode
+        std::string decoded;
+        for ( char32_t ch : values )
+        {
+            char buffer[4];
+            decoded.append( buffer, dmk::utf8::encode( buffer, ch ) );
+        }
+        check( dmk::iequals( input, decoded ), "iequals with the decoded code points", input );
+        check( dmk::ihash( input ) == dmk::ihash( decoded ), "ihash of the decoded code points", input );
+    }
+
+    // a run of stray continuation bytes after an ASCII char is one REPL_CHAR of its own
+    void stray_continuations( )
+    {
+        const char* input = "a\x80\x80"
+                            "b";
+        check( dmk::utf8::length_unsafe( input ) == 3, "length with stray continuations", input );
+        check( dmk::u8_u32( input ) == U"a\uFFFDb", "u8_u32 with stray continuations", input );
+        check( !dmk::iequals( input, "ab" ), "iequals ignoring stray continuations", input );
+        check( dmk::ihash( input ) != dmk::ihash( "ab" ), "ihash ignoring stray continuations", input );
+
+        dmk::u8string ascii( "a" ), lead( "\xC3" ), tail( "\x80" );
+        ascii.length( );
+        lead.length( );
+        tail.length( );
+        ascii += tail;
+        lead += tail;
+        check( ascii.length( ) == 2, "cached length of \"a\" += \"\\x80\"", ascii.c_str( ) );
+        check( lead.length( ) == 1, "cached length of \"\\xC3\" += \"\\x80\"", lead.c_str( ) );
+    }
+
+    // the cached length and ASCII flag must follow changes made through the mutable accessors
+    void cached_properties( )
+    {
+        check( !dmk::u8string( "\xE9" ).is_ascii( ), "is_ascii of a lone lead byte", "\xE9" );
+
+        dmk::u8string str( "hello" );
+        check( str.is_ascii( ) && str.length( ) == 5, "cached length", "hello" );
+        std::string& bytes = str.str( );
+        check( str.length( ) == 5, "length read before changing", "hello" );
+        bytes = "h\xC3\xA9llo!";
+        check( str.length( ) == 6 && !str.is_ascii( ), "length after changing str( )", bytes.c_str( ) );
+        str.data( )[0] = 'j';
+        str.invalidate( );
+        check( str.length( ) == 6 && str[0] == 'j', "length after invalidate( )", str.c_str( ) );
+    }
+
+    // operator+ yields a plain u8string and appends to temporaries, concat( ) joins mixed pieces
+    void concatenation( )
+    {
+        dmk::u8string a( "h\xC3\xA9" ), b( "llo" );
+        check( ( a + b ).length( ) == 5, "length of a + b", "h\xC3\xA9llo" );
+        dmk::u8string joined = a + "/" + b;
+        dmk::u8string_view view( joined );
+        check( view.size( ) == 7, "view of a + \"/\" + b", joined.c_str( ) );
+        dmk::u8string chain = a + "/" + b + "/" + a + b;
+        check( chain.str( ) == "h\xC3\xA9/llo/h\xC3\xA9llo" && chain.length( ) == 12, "operator+ chain",
+               chain.c_str( ) );
+        check( a.str( ) == "h\xC3\xA9" && b.str( ) == "llo", "operands of a chain", a.c_str( ) );
+        std::string dir( "dir" );
+        dmk::u8string path = dmk::concat( a, "/", dir, '/', dmk::u8string_view( b ) );
+        check( path.str( ) == "h\xC3\xA9/dir/llo" && path.length( ) == 10, "concat", path.c_str( ) );
+    }
+
+    // tokens of text fed to a splitter in chunks of the given size
+    template <typename _Set>
+    std::vector<std::string> split_in_chunks( const std::string& text, size_t chunk, dmk::split_mode mode )
+    {
+        std::vector<std::string> tokens;
+        dmk::splitter<_Set> parts( _Set( ), mode );
+        dmk::u8string_view token;
+        for ( size_t pos = 0; pos < text.size( ); pos += chunk )
+        {
+            parts.feed( dmk::u8string_view( text.data( ) + pos, std::min( chunk, text.size( ) - pos ) ) );
+            while ( parts.next( token ) )
+            {
+                tokens.push_back( token.str( ) );
+            }
+        }
+        parts.finish( );
+        while ( parts.next( token ) )
+        {
+            tokens.push_back( token.str( ) );
+        }
+        return tokens;
+    }
+
+    // the same tokens whether the text comes at once or in chunks that cut tokens and delimiter runs
+    void splitting( )
+    {
+        const std::string long_token( 100, 'x' ); // longer than the 64-byte delimiter mask
+        const size_t chunks[] = { 1, 2, 3, 7, 63, 64, 65, 1000 };
+
+        std::string words = "  alpha beta\t\tgamma \n" + long_token + "  end ";
+        std::vector<std::string> expected_words = { "alpha", "beta", "gamma", long_token, "end" };
+        std::vector<std::string> whole;
+        for ( dmk::u8string_view token : dmk::splitter<>( words ) )
+        {
+            whole.push_back( token.str( ) );
+        }
+        check( whole == expected_words, "splitter over one string", words.c_str( ) );
+        for ( size_t chunk : chunks )
+        {
+            check( split_in_chunks<dmk::whitespace>( words, chunk, dmk::split_mode::merge_delimiters ) ==
+                       expected_words,
+                   "splitter fed in chunks", words.c_str( ) );
+        }
+
+        std::string fields = ",a,,b," + long_token + ",c,";
+        std::vector<std::string> expected_fields = { "", "a", "", "b", long_token, "c", "" };
+        for ( size_t chunk : chunks )
+        {
+            check( split_in_chunks<dmk::chars<','>>( fields, chunk, dmk::split_mode::keep_empty ) ==
+                       expected_fields,
+                   "splitter keep_empty fed in chunks", fields.c_str( ) );
+        }
+        check( split_in_chunks<dmk::chars<','>>( "", 1, dmk::split_mode::keep_empty ).empty( ),
+               "splitter keep_empty on empty text", "" );
+        check( dmk::tokenize( " a  b " ).size( ) == 2, "tokenize", " a  b " );
+    }
+
+    void globbing( )
+    {
+        struct
+        {
+            const char* pattern;
+            const char* text;
+            bool expected;
+        } cases[] = {
+            { "", "", true },
+            { "", "a", false },
+            { "*", "", true },
+            { "*.txt", "notes.txt", true },
+            { "*.txt", "notes.txt.bak", false },
+            { "?", "\xC3\xA9", true }, // one code point of two bytes
+            { "??", "\xC3\xA9", false },
+            { "a?c", "abc", true },
+            { "a?c", "ac", false },
+            { "[a-c]x", "bx", true },
+            { "[a-c]x", "dx", false },
+            { "[!a-c]x", "dx", true },
+            { "[^a-c]x", "ax", false },
+            { "[_0-9]*", "7up", true },
+            { "[\xC3\xA0-\xC3\xBF]", "\xC3\xA9", true },
+            { "\\*", "*", true },
+            { "\\*", "a", false },
+            { "!*.txt", "a.txt", false },
+            { "!*.txt", "a.md", true },
+            { "ab*ba", "aba", false }, // prefix and suffix must not overlap
+            { "ab*ba", "abba", true },
+            { "ab*ba", "abXba", true },
+            { "a*a*a", "aa", false },
+            { "a*a*a", "aaa", true },
+            { "a*b*c", "aXbYbZc", true },
+            { "*ab", "abab", true },
+            { "*b*a", "ba", true },
+            { "*\xC3\xA9*", "caf\xC3\xA9s", true },
+        };
+        for ( const auto& c : cases )
+        {
+            check( dmk::glob( c.pattern ).matches( c.text ) == c.expected, "glob", c.pattern );
+            check( dmk::matches( c.pattern, c.text ) == c.expected, "matches", c.pattern );
+        }
+
+        dmk::glob_set sources{ "*.cpp", "*.h", "!test_*", "!*_old.*" };
+        check( sources.matches( "main.cpp" ) && sources.matches( "dmk.h" ), "glob_set include", "*.cpp" );
+        check( !sources.matches( "test_main.cpp" ), "glob_set exclude", "!test_*" );
+        check( !sources.matches( "main_old.cpp" ) && !sources.matches( "notes.txt" ), "glob_set", "*.cpp" );
+        dmk::glob_set only_exclude{ "!*.tmp" };
+        check( only_exclude.matches( "a.txt" ) && !only_exclude.matches( "a.tmp" ), "glob_set exclude only",
+               "!*.tmp" );
+        // patterns sharing and not sharing literal prefixes
+        dmk::glob_set paths{ "src/*.cpp", "src/a*", "lib/*", "s?c/x" };
+        std::vector<std::string> texts = { "src/b.cpp", "src/a.h", "src/b.h", "lib/x", "sec/x", "lib" };
+        std::vector<std::string> passed;
+        paths.filter( texts.begin( ), texts.end( ), std::back_inserter( passed ) );
+        std::vector<std::string> expected = { "src/b.cpp", "src/a.h", "lib/x", "sec/x" };
+        check( passed == expected, "glob_set filter", "src/*.cpp" );
+    }
+
+    void replacement( )
+    {
+        check( dmk::replace_all( "a.b.c", ".", "::" ) == "a::b::c", "replace_all longer", "a.b.c" );
+        check( dmk::replace_all( "a::b::c", "::", "" ) == "abc", "replace_all shorter", "a::b::c" );
+        check( dmk::replace_all( "aaaaa", "aa", "b" ) == "bba", "replace_all without overlaps", "aaaaa" );
+        check( dmk::replace_all( "abc", "x", "y" ) == "abc" && dmk::replace_all( "abc", "", "y" ) == "abc",
+               "replace_all without matches", "abc" );
+        check( dmk::replace_all( "\xC3\xA9t\xC3\xA9", "\xC3\xA9", "e" ) == "ete", "replace_all UTF-8",
+               "\xC3\xA9t\xC3\xA9" );
+
+        dmk::multi_replacer escape{ { "&", "&amp;" }, { "<", "&lt;" }, { ">", "&gt;" } };
+        std::string output;
+        check( escape.apply( "a<b && c>d", output ) == 4 && output == "a&lt;b &amp;&amp; c&gt;d",
+               "multi_replacer count and output", "a<b && c>d" );
+        check( escape.apply( "plain", output ) == 0 && output == "plain", "multi_replacer without matches",
+               "plain" );
+        dmk::multi_replacer first_wins{ { "a", "1" }, { "a", "2" }, { "bc", "Y" }, { "ab", "X" } };
+        check( first_wins.apply( "abc" ) == "Xc", "multi_replacer leftmost before longer", "abc" );
+        check( first_wins.apply( "aa" ) == "11", "multi_replacer first rule for a pattern", "aa" );
+        dmk::multi_replacer digits{ { "a", "1" }, { "ab", "2" }, { "abc", "3" } };
+        check( digits.apply( "xabcabax" ) == "x321x", "multi_replacer leftmost-longest", "xabcabax" );
+
+        // rules using all 256 byte values need 256 byte classes besides the empty one
+        std::string every_byte;
+        for ( int i = 0; i < 256; i++ )
+        {
+            every_byte += char( i );
+        }
+        std::string zero_bang( "\0!", 2 );
+        dmk::multi_replacer all{ { every_byte, "*" }, { "\xFF!", "F" } };
+        check( all.apply( "x" + every_byte + "x" ) == "x*x", "multi_replacer with every byte", "x...x" );
+        check( all.apply( zero_bang ) == zero_bang, "multi_replacer byte classes stay apart", "\\0!" );
+        check( all.apply( "\xFF!" ) == "F", "multi_replacer with every byte, second rule", "\xFF!" );
+    }
+
+    // threads interning overlapping keys in different orders, across many table growths, must
+    // agree on one handle per string and get dense unique ids
+    void concurrent_interning( )
+    {
+        const int threads = 4;
+        const int keys    = 5000;
+        dmk::intern_pool pool;
+        std::vector<std::vector<dmk::interned>> handles( threads );
+        std::vector<std::thread> workers;
+        for ( int t = 0; t < threads; t++ )
+        {
+            workers.emplace_back( [&, t] {
+                handles[t].resize( keys );
+                for ( int n = 0; n < keys; n++ )
+                {
+                    int key         = t % 2 ? keys - 1 - n : n;
+                    handles[t][key] = pool.intern( "key/" + std::to_string( key ) );
+                }
+            } );
+        }
+        for ( std::thread& worker : workers )
+        {
+            worker.join( );
+        }
+        check( pool.size( ) == size_t( keys ), "intern_pool size", "key/..." );
+        std::vector<bool> seen( keys, false );
+        bool same = true, ids = true;
+        for ( int key = 0; key < keys; key++ )
+        {
+            dmk::interned handle = handles[0][key];
+            for ( int t = 1; t < threads; t++ )
+            {
+                same = same && handles[t][key] == handle;
+            }
+            same = same && handle.view( ) == dmk::u8string_view( "key/" + std::to_string( key ) ) &&
+                   pool.find( handle.view( ) ) == handle;
+            uint32_t id = handle.id( );
+            ids         = ids && id < uint32_t( keys ) && !seen[id] && pool.at( id ) == handle;
+            if ( id < uint32_t( keys ) )
+                seen[id] = true;
+        }
+        check( same, "intern_pool one handle per string", "key/..." );
+        check( ids, "intern_pool dense unique ids", "key/..." );
+    }
+} // namespace
+
+int main( )
+{
+    const char* inputs[] = {
+        "a\x80"
+        "b",
+        "\x80\x80x",
+        "a\x80\x80\x80\x80\x80\x80\x80",
+        "\xC3\xA9\x80z",
+        "\xC3\x80\x80\x80\x80\x80\x80"
+        "b",
+        "\xE2\x82",
+        "\xF0\x9F\x98\x80\xBF",
+        "0123456789abcdef\x80tail",
+        "0123456789abcdef0123456789abcdef\x80\x80tail",
+        "\xE9",
+    };
+    for ( const char* input : inputs )
+    {
+        malformed_input( input );
+    }
+    stray_continuations( );
+    cached_properties( );
+    concatenation( );
+    splitting( );
+    globbing( );
+    replacement( );
+    concurrent_interning( );
+    std::printf( "%d failures\n", failures );
+    return failures;
+}